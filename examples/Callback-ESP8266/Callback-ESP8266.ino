@@ -30,30 +30,44 @@
 #define EXTRACT "data/create.txt"
 
 Tar<FS> tar(&SPIFFS);
-bool fWrite = false;
-const char* filename = EXTRACT;
 
-bool printFile(const char* name) {
+// State shared by the callbacks, passed to them as context pointer
+struct Blinker {
+	const char* filename;
+	int pin;
+	bool fWrite;
+};
+Blinker blinker = { EXTRACT, PIN, false };
+
+bool printFile(void* ctx, char* name) {
+	Blinker* b = (Blinker*)ctx;
 	Serial.print(name);
-	if (strcmp(name, filename) == 0) {
+	if (strcmp(name, b->filename) == 0) {
 		Serial.println();
-		fWrite = true;
+		b->fWrite = true;
 		return true;
 	}
 	Serial.println(" -  SKIP");
 	return false;
 }
 
-void blinkWrite(const char* data, size_t s) {
+void blinkWrite(void* ctx, char* data, size_t s) {
+	Blinker* b = (Blinker*)ctx;
 	(void)data;
 	(void)s;
-	if (!fWrite) return;
-	digitalWrite(PIN, !digitalRead(PIN));
+	if (!b->fWrite) return;
+	digitalWrite(b->pin, !digitalRead(b->pin));
 }
 
-void eof() {
-  digitalWrite(PIN, HIGH);  
-	fWrite = false;
+void eof(void* ctx, const char* name, size_t size, tar_state state) {
+	Blinker* b = (Blinker*)ctx;
+	if (b->fWrite) {
+		Serial.print(name);
+		Serial.print(state == TAR_DONE? " - done, size ": " - FAILED, size ");
+		Serial.println((unsigned long)size);
+	}
+	digitalWrite(b->pin, HIGH);
+	b->fWrite = false;
 }
 
 void setup() {
@@ -61,9 +75,9 @@ void setup() {
   pinMode(PIN, OUTPUT);
   digitalWrite(PIN, HIGH);
   SPIFFS.begin();
-  tar.onFile((cbTarProcess)printFile);
-  tar.onData((cbTarData)blinkWrite);
-  tar.onEof(eof);
+  tar.onFile(printFile, &blinker);
+  tar.onData(blinkWrite, &blinker);
+  tar.onEof(eof, &blinker);
   File f = SPIFFS.open(FILENAME, "r");
   if (f) {
     tar.open((Stream*)&f);
@@ -32,28 +32,32 @@ const char* password = "pass";
 
 ESP8266WebServer server(80);
 const char* serverIndex = "<form method='POST' action='/update' enctype='multipart/form-data'><input type='file' name='update'><input type='submit' value='Update'></form>";
-Tar<FS> tar(&SPIFFS);
 StreamBuf sb;
 
-bool tarFile(char* b) {
-  return false;
-}
-
-void tarData(char* b, size_t s) {
-  if(Update.write((uint8_t*)b, s) != s){
-    Update.printError(Serial);
+// Sink passed as template parameter, so Update.write is called directly from the data loop
+struct UpdateSink {
+  bool file(char* b) {
+    (void)b;
+    return false;
   }
-}
+  void data(char* b, size_t s) {
+    if(Update.write((uint8_t*)b, s) != s){
+      Update.printError(Serial);
+    }
+  }
+  void eof(const char* name, size_t size, tar_state state) {
+    Serial.printf("EOF %s (%u bytes, state %d)\n", name, (unsigned)size, (int)state);
+    //if(Update.end(true)){ //true to set the size to the current progress
+    //  Serial.printf("Update Success: %u\nRebooting...\n", 0);
+    //} else {
+    //  Update.printError(Serial);
+    //}
+    //Serial.setDebugOutput(false);
+  }
+};
 
-void tarEof() {
-  Serial.println("EOF");
-  //if(Update.end(true)){ //true to set the size to the current progress
-  //  Serial.printf("Update Success: %u\nRebooting...\n", 0);
-  //} else {
-  //  Update.printError(Serial);
-  //}
-  //Serial.setDebugOutput(false);
-}
+Tar<FS, UpdateSink> tar(&SPIFFS);
+UpdateSink updateSink;
 
 void setup(void){
   Serial.begin(74880);
@@ -63,9 +67,7 @@ void setup(void){
   WiFi.begin(ssid, password);
   if(WiFi.waitForConnectResult() == WL_CONNECTED){
     SPIFFS.begin();
-    tar.onFile(tarFile);
-    tar.onData(tarData);
-    tar.onEof(tarEof);
+    tar.sink(&updateSink);
     tar.dest("/");
     MDNS.begin(host);
     server.on("/", HTTP_GET, [](){
@@ -0,0 +1,227 @@
+/*
+ * Read-only filesystem serving the members of a tar archive in place.
+ *
+ * begin() scans the headers of a seekable archive once and indexes the
+ * regular files; open() then returns a Stream reading the member directly
+ * from the archive, so nothing is extracted and no extra flash is used.
+ * Names are matched without leading "/" or "./", e.g. open("/index.html").
+ * The archive type F needs readBytes() and seek(), e.g. File.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "untar.h"
+
+template <typename F>
+class TarFS;
+
+template <typename F>
+class TarFSFile : public Stream {
+public:
+	TarFSFile() : Stream() {
+		fs = NULL;
+		index = -1;
+		pos = 0;
+	}
+	TarFSFile(TarFS<F>* pfs, int pindex) : Stream() {
+		fs = pfs;
+		index = pindex;
+		pos = 0;
+	}
+	TarFSFile& operator=(const TarFSFile& from) {
+		fs = from.fs;
+		index = from.index;
+		pos = from.pos;
+		return *this;
+	}
+	size_t read(uint8_t* buf, size_t size);
+	size_t readBytes(char* buffer, size_t length) { return read((uint8_t*)buffer, length); }
+	int read() {
+		uint8_t c;
+		return read(&c, 1) == 1? c: -1;
+	}
+	int peek();
+	int available() { return size() - pos; }
+	size_t write(uint8_t c) {		// Read-only
+		(void)c;
+		return 0;
+	}
+	bool seek(size_t p) {
+		if (!isOpen() || p > size()) return false;
+		pos = p;
+		return true;
+	}
+	size_t position() { return pos; }
+	size_t size();
+	const char* name();
+	bool isOpen() { return fs != NULL && index >= 0; }
+	operator bool() { return isOpen(); }
+	int close() {
+		fs = NULL;
+		index = -1;
+		pos = 0;
+		return 0;
+	}
+private:
+	TarFS<F>* fs;
+	int index;				// Entry in the index of fs
+	size_t pos;
+};
+
+template <typename F>
+class TarFS : private TarHeader {
+public:
+	TarFS() {}
+	~TarFS() { end(); }
+	bool begin(F* src);			// Index the archive, 'false' on a corrupt header or no memory
+	void end();				// Drop the index; open files become invalid
+	TarFSFile<F> open(const char* name, const char* mode = "r");	// Only "r" is supported
+	bool exists(const char* name) { return lookup(name) >= 0; }
+	size_t count() { return entries; }
+	const char* name(size_t i) { return i < entries? table[i].name: NULL; }
+private:
+	friend class TarFSFile<F>;
+	struct entry {
+		char* name;
+		uint32_t offset;		// Of the member's data in the archive
+		uint32_t size;
+		uint32_t hash;
+	};
+	F* archive = NULL;
+	size_t apos = 0;			// Current position of 'archive', saves seeks on sequential reads
+	entry* table = NULL;
+	size_t entries = 0;
+	size_t allocated = 0;
+	static const char* strip(const char* name) {
+		while (name[0] == '/' || (name[0] == '.' && name[1] == '/'))
+			name += name[0] == '/'? 1: 2;
+		return name;
+	}
+	int lookup(const char* name) {
+		return TarNames::lookup([this](int i) { return &table[i]; }, entries, strip(name));
+	}
+	bool add(const char* hdr, size_t offset, size_t size);
+	size_t read_at(size_t offset, uint8_t* buf, size_t size);
+};
+
+template <typename F>
+bool TarFS<F>::begin(F* src) {
+	char hdr[512];
+	end();
+	archive = src;
+	apos = 0;
+	if (!archive->seek(0)) return false;
+	for (;;) {
+		if (archive->readBytes(hdr, 512) != 512 || is_end_of_archive(hdr))
+			break;
+		apos += 512;
+		if (!verify_checksum(hdr)) {
+			end();
+			return false;
+		}
+		size_t size = parseoct(hdr + 124, 12);
+		if (hdr[156] < '1' || hdr[156] > '6') {		// Regular file, as in Tar::extract()
+			if (!add(hdr, apos, size)) {
+				end();
+				return false;
+			}
+		} else {
+			size = 0;
+		}
+		apos += (size + 511) & ~(size_t)511;
+		if (size && !archive->seek(apos))
+			break;
+	}
+	return true;
+}
+
+template <typename F>
+bool TarFS<F>::add(const char* hdr, size_t offset, size_t size) {
+	if (entries == allocated) {
+		size_t n = allocated? 2 * allocated: 16;
+		entry* p = (entry*)realloc(table, n * sizeof(entry));
+		if (p == NULL) return false;
+		table = p;
+		allocated = n;
+	}
+	/* POSIX ustar: name may be continued in the prefix field. Old GNU ("ustar  ") keeps times there */
+	size_t plen = memcmp(hdr + 257, "ustar", 6) == 0? strnlen(hdr + 345, 155): 0;
+	size_t nlen = strnlen(hdr, 100);
+	char* name = (char*)malloc(plen + 1 + nlen + 1);
+	if (name == NULL) return false;
+	name[0] = '\0';
+	if (plen) {
+		memcpy(name, hdr + 345, plen);
+		name[plen++] = '/';
+	}
+	memcpy(name + plen, hdr, nlen);
+	name[plen + nlen] = '\0';
+	const char* s = strip(name);
+	memmove(name, s, strlen(s) + 1);
+	entry* e = &table[entries++];
+	e->name = name;
+	e->offset = offset;
+	e->size = size;
+	e->hash = TarNames::hash(name);
+	return true;
+}
+
+template <typename F>
+void TarFS<F>::end() {
+	for (size_t i = 0; i < entries; ++i)
+		free(table[i].name);
+	if (table) free(table);
+	table = NULL;
+	entries = allocated = 0;
+}
+
+template <typename F>
+TarFSFile<F> TarFS<F>::open(const char* name, const char* mode) {
+	if (mode[0] != 'r' || mode[1] == '+')
+		return TarFSFile<F>();
+	int i = lookup(name);
+	return i < 0? TarFSFile<F>(): TarFSFile<F>(this, i);
+}
+
+template <typename F>
+size_t TarFS<F>::read_at(size_t offset, uint8_t* buf, size_t size) {
+	if (offset != apos) {
+		if (!archive->seek(offset)) return 0;
+		apos = offset;
+	}
+	size_t n = archive->readBytes((char*)buf, size);
+	apos += n;
+	return n;
+}
+
+template <typename F>
+size_t TarFSFile<F>::read(uint8_t* buf, size_t size) {
+	if (!isOpen()) return 0;
+	size_t left = this->size() - pos;
+	if (size > left) size = left;
+	size_t n = size? fs->read_at(fs->table[index].offset + pos, buf, size): 0;
+	pos += n;
+	return n;
+}
+
+template <typename F>
+int TarFSFile<F>::peek() {
+	uint8_t c;
+	if (read(&c, 1) != 1) return -1;
+	--pos;
+	return c;
+}
+
+template <typename F>
+size_t TarFSFile<F>::size() {
+	return isOpen()? fs->table[index].size: 0;
+}
+
+template <typename F>
+const char* TarFSFile<F>::name() {
+	return isOpen()? fs->table[index].name: NULL;
+}
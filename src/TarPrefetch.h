@@ -0,0 +1,216 @@
+/*
+ * Read-ahead stage for untar.
+ *
+ * Wraps the source Stream and keeps a bounded ring of upcoming blocks filled,
+ * so the source is read while Tar parses headers and writes files.
+ * Pass it to Tar::open() in place of the source.
+ *
+ * Only with TAR_PREFETCH_THREAD defined (host, ESP32) is the source read ahead
+ * concurrently, by a background thread; fill() then does nothing.
+ * Without it nothing is read while extract() runs: the ring is refilled with one
+ * large read whenever it runs empty, which only coalesces small source reads.
+ * Calling fill() between extract() calls (e.g. from loop() after a short read)
+ * reads ahead into the free space.
+ *
+ * A short read from the source is not its end, as with Tar: only a read returning
+ * nothing or a closed source ends the stream, and the next readBytes() tries again.
+ * Tar::extract() closes its source on every return, so close() only stops the reader
+ * and keeps the source: extract() can be called again after a short read. end()
+ * closes the source when the archive is done with.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TAR_PREFETCH_THREAD
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+class TarPrefetch : public Stream {
+public:
+	TarPrefetch(Stream* src, size_t blocks = 4) : Stream() {
+		source = src;
+		capacity = blocks * 512;
+		ring = (char*)malloc(capacity);
+		if (ring == NULL) capacity = 0;
+	}
+	~TarPrefetch() {
+		stop();
+		if (ring) free(ring);
+	}
+	size_t readBytes(char* buffer, size_t length);	// Blocks until 'length' bytes or end of source
+	size_t fill();				// Read source into free ring space, returns bytes read
+	int available();
+	int read() {
+		char c;
+		return readBytes(&c, 1) == 1? (uint8_t)c: -1;
+	}
+	int peek();
+	size_t write(uint8_t c) {
+		(void)c;
+		return 0;
+	}
+	bool isOpen() { return source != NULL && ring != NULL; }
+	int close() {				// Stops the reader, the next readBytes() restarts it
+		stop();
+		return 0;
+	}
+	void end() {				// Stops the reader and closes the source
+		stop();
+		if (source != NULL && source->isOpen()) source->close();
+		source = NULL;
+	}
+private:
+	Stream* source;
+	char* ring;
+	size_t capacity;
+	size_t head = 0;			// Next byte to hand out
+	size_t count = 0;			// Bytes in the ring
+	bool eof = false;			// Source returned nothing or is closed; it is asked again on the next read
+	size_t take(char* buffer, size_t length);	// Copy out what is available
+	size_t read_free(size_t limit);		// Read source into the contiguous free space
+	#ifdef TAR_PREFETCH_THREAD
+	std::thread reader;
+	std::mutex lock;
+	std::condition_variable changed;
+	bool running = false;
+	void run();
+	#endif
+	void stop() {
+		#ifdef TAR_PREFETCH_THREAD
+		if (running) {
+			{
+				std::lock_guard<std::mutex> g(lock);
+				running = false;
+			}
+			changed.notify_all();
+			reader.join();
+		}
+		#endif
+	}
+};
+
+inline size_t TarPrefetch::take(char* buffer, size_t length) {
+	size_t done = 0;
+	while (done < length && count > 0) {
+		size_t n = capacity - head;		// Contiguous part
+		if (n > count) n = count;
+		if (n > length - done) n = length - done;
+		memcpy(buffer + done, ring + head, n);
+		head = (head + n) % capacity;
+		count -= n;
+		done += n;
+	}
+	return done;
+}
+
+inline size_t TarPrefetch::read_free(size_t limit) {
+	size_t tail = (head + count) % capacity;
+	size_t n = capacity - tail;
+	if (n > capacity - count) n = capacity - count;
+	if (n > limit) n = limit;
+	if (n == 0 || eof) return 0;
+	size_t r = source->isOpen()? source->readBytes(ring + tail, n): 0;
+	if (r == 0) eof = true;
+	return r;
+}
+
+#ifdef TAR_PREFETCH_THREAD
+inline void TarPrefetch::run() {
+	std::unique_lock<std::mutex> g(lock);
+	while (running && !eof) {
+		if (count == capacity) {
+			changed.wait(g);
+			continue;
+		}
+		/* Read at most a block outside the lock, the consumer may take meanwhile */
+		size_t tail = (head + count) % capacity;
+		size_t n = capacity - tail;
+		if (n > capacity - count) n = capacity - count;
+		if (n > 512) n = 512;
+		g.unlock();
+		size_t r = source->isOpen()? source->readBytes(ring + tail, n): 0;
+		g.lock();
+		count += r;
+		if (r == 0) eof = true;
+		changed.notify_all();
+	}
+	changed.notify_all();
+}
+
+inline size_t TarPrefetch::readBytes(char* buffer, size_t length) {
+	if (!isOpen()) return 0;
+	std::unique_lock<std::mutex> g(lock);
+	if (running && eof && count == 0) {	// Reader stopped at the end of what the source had
+		g.unlock();
+		reader.join();
+		g.lock();
+		running = false;
+	}
+	if (!running) {
+		eof = false;
+		running = true;
+		reader = std::thread(&TarPrefetch::run, this);
+	}
+	size_t done = 0;
+	while (done < length) {
+		done += take(buffer + done, length - done);
+		changed.notify_all();
+		if (done == length || (eof && count == 0)) break;
+		changed.wait(g);
+	}
+	return done;
+}
+
+inline size_t TarPrefetch::fill() {
+	return 0;		// The reader thread does it
+}
+
+inline int TarPrefetch::available() {
+	std::lock_guard<std::mutex> g(lock);
+	return count;
+}
+
+inline int TarPrefetch::peek() {
+	std::unique_lock<std::mutex> g(lock);
+	while (count == 0 && running && !eof) changed.wait(g);
+	return count? (uint8_t)ring[head]: -1;
+}
+#else
+inline size_t TarPrefetch::readBytes(char* buffer, size_t length) {
+	if (!isOpen()) return 0;
+	size_t done = take(buffer, length);
+	while (done < length) {
+		if (fill() == 0) break;
+		done += take(buffer + done, length - done);
+	}
+	return done;
+}
+
+inline size_t TarPrefetch::fill() {
+	if (!isOpen()) return 0;
+	eof = false;
+	size_t r = read_free(capacity);
+	count += r;
+	if (r > 0 && count < capacity) {	// Wrapped or short: try the rest of the free space
+		size_t r2 = read_free(capacity);
+		count += r2;
+		r += r2;
+	}
+	return r;
+}
+
+inline int TarPrefetch::available() {
+	return count;
+}
+
+inline int TarPrefetch::peek() {
+	if (count == 0) fill();
+	return count? (uint8_t)ring[head]: -1;
+}
+#endif
@@ -0,0 +1,234 @@
+/*
+ * In-memory extraction target for untar.
+ *
+ * Members are placed into a caller-provided arena: names and data are
+ * allocated from the front, the name lookup table grows down from the back.
+ * Use as Tar<TarRamFS>, then open(name, "r") or data(name, &size) to serve them.
+ * Space of removed or overwritten members is only reclaimed by clear().
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "untar.h"
+
+class TarRamFS;
+
+class TarRamFile {
+public:
+	TarRamFile() {
+		fs = NULL;
+		index = -1;
+		pos = 0;
+		writable = false;
+	}
+	TarRamFile(TarRamFS* pfs, int pindex, bool pwritable) {
+		fs = pfs;
+		index = pindex;
+		pos = 0;
+		writable = pwritable;
+	}
+	size_t write(const uint8_t* buf, size_t size);
+	size_t write(uint8_t c) { return write(&c, 1); }
+	size_t read(uint8_t* buf, size_t size);
+	size_t readBytes(char* buf, size_t size) { return read((uint8_t*)buf, size); }
+	int read() {
+		uint8_t c;
+		return read(&c, 1) == 1? c: -1;
+	}
+	int peek();
+	int available() { return isOpen()? size() - pos: 0; }
+	bool reserve(size_t size);		// Preallocate exactly 'size' bytes, 'false' if they don't fit
+	bool seek(size_t p) {
+		if (!isOpen() || p > size()) return false;
+		pos = p;
+		return true;
+	}
+	bool truncate(size_t size);
+	size_t position() { return pos; }
+	size_t size();
+	const char* name();
+	const uint8_t* data();			// Member bytes in the arena, no copy
+	void flush() {}
+	void close();
+	bool isOpen() { return fs != NULL && index >= 0; }
+	operator bool() { return isOpen(); }
+private:
+	TarRamFS* fs;
+	int index;				// Entry in the lookup table
+	size_t pos;
+	bool writable;
+};
+
+class TarRamFS {
+public:
+	TarRamFS(void* arena, size_t len) {
+		base = (uint8_t*)arena;
+		/* The table sits at the end of the arena, keep it aligned */
+		uintptr_t end = ((uintptr_t)arena + len) & ~(uintptr_t)(sizeof(void*) - 1);
+		table = (entry*)end;
+		clear();
+	}
+	TarRamFile open(const char* name, const char* mode);
+	bool exists(const char* name) { return lookup(name) >= 0; }
+	bool remove(const char* name);
+	int mkdir(const char* name, int mode) {	// Flat namespace, directories are implied by names
+		(void)name;
+		(void)mode;
+		return 0;
+	}
+	const uint8_t* data(const char* name, size_t* size);	// NULL if not found
+	size_t count() { return entries; }		// Number of table entries, removed ones included
+	const char* name(size_t i);			// Name of entry 'i', NULL if removed
+	size_t used() { return top + entries * sizeof(entry); }
+	size_t available() {
+		uint8_t* start = growing >= 0? at(growing)->data + at(growing)->size: base + top;
+		return free_end() - start;
+	}
+	void clear() {
+		top = 0;
+		entries = 0;
+		growing = -1;
+	}
+private:
+	friend class TarRamFile;
+	struct entry {
+		const char* name;		// NULL if removed
+		uint8_t* data;
+		uint32_t size;
+		uint32_t capacity;
+		uint32_t hash;
+	};
+	uint8_t* base;
+	entry* table;				// One past the first entry, entries grow downwards
+	size_t top;				// Bytes allocated from the front
+	size_t entries;
+	int growing;				// Entry that may still grow into the free space, -1 if none
+	entry* at(int i) { return table - 1 - i; }
+	uint8_t* free_end() { return (uint8_t*)(table - entries); }
+	int lookup(const char* name) {
+		return TarNames::lookup([this](int i) { return at(i); }, entries, name);
+	}
+	void freeze() {				// Stop growing the last entry, its capacity becomes its size
+		if (growing >= 0) {
+			entry* e = at(growing);
+			e->capacity = e->size;
+			top = (e->data - base) + e->size;
+			growing = -1;
+		}
+	}
+};
+
+inline TarRamFile TarRamFS::open(const char* name, const char* mode) {
+	if (mode[0] != 'w') {
+		int i = lookup(name);
+		if (i < 0) return TarRamFile();
+		TarRamFile rf(this, i, mode[1] == '+');
+		if (mode[0] == 'a') rf.seek(at(i)->size);
+		return rf;
+	}
+	freeze();
+	size_t namelen = strlen(name) + 1;
+	size_t datastart = (top + namelen + 3) & ~(size_t)3;
+	if ((uint8_t*)(table - entries - 1) < base + datastart) {
+		return TarRamFile();		// No room, an existing member is kept
+	}
+	remove(name);
+	entry* e = at(entries);
+	memcpy(base + top, name, namelen);
+	e->name = (const char*)(base + top);
+	e->data = base + datastart;
+	e->size = 0;
+	e->capacity = 0;
+	e->hash = TarNames::hash(name);
+	top = datastart;
+	growing = entries++;
+	return TarRamFile(this, growing, true);
+}
+
+inline bool TarRamFS::remove(const char* name) {
+	int i = lookup(name);
+	if (i < 0) return false;
+	if (i == growing) freeze();
+	at(i)->name = NULL;
+	return true;
+}
+
+inline const uint8_t* TarRamFS::data(const char* name, size_t* size) {
+	int i = lookup(name);
+	if (i < 0) return NULL;
+	if (size) *size = at(i)->size;
+	return at(i)->data;
+}
+
+inline const char* TarRamFS::name(size_t i) {
+	return i < entries? at(i)->name: NULL;
+}
+
+inline size_t TarRamFile::write(const uint8_t* buf, size_t size) {
+	if (!isOpen() || !writable) return 0;
+	TarRamFS::entry* e = fs->at(index);
+	size_t limit = index == fs->growing? fs->free_end() - e->data: e->capacity;
+	if (pos > limit) return 0;
+	if (size > limit - pos) size = limit - pos;
+	memcpy(e->data + pos, buf, size);
+	pos += size;
+	if (pos > e->size) e->size = pos;
+	return size;
+}
+
+inline size_t TarRamFile::read(uint8_t* buf, size_t size) {
+	if (!isOpen()) return 0;
+	TarRamFS::entry* e = fs->at(index);
+	if (pos >= e->size) return 0;
+	if (size > e->size - pos) size = e->size - pos;
+	memcpy(buf, e->data + pos, size);
+	pos += size;
+	return size;
+}
+
+inline int TarRamFile::peek() {
+	if (!isOpen() || pos >= size()) return -1;
+	return fs->at(index)->data[pos];
+}
+
+inline bool TarRamFile::reserve(size_t size) {
+	if (!isOpen() || !writable) return false;
+	TarRamFS::entry* e = fs->at(index);
+	if (index != fs->growing) return size <= e->capacity;
+	if (size > (size_t)(fs->free_end() - e->data)) return false;
+	e->capacity = size;
+	fs->top = (e->data - fs->base) + size;
+	fs->growing = -1;
+	return true;
+}
+
+inline bool TarRamFile::truncate(size_t size) {
+	if (!isOpen() || !writable || size > this->size()) return false;
+	fs->at(index)->size = size;
+	if (pos > size) pos = size;
+	return true;
+}
+
+inline size_t TarRamFile::size() {
+	return isOpen()? fs->at(index)->size: 0;
+}
+
+inline const char* TarRamFile::name() {
+	return isOpen()? fs->at(index)->name: NULL;
+}
+
+inline const uint8_t* TarRamFile::data() {
+	return isOpen()? fs->at(index)->data: NULL;
+}
+
+inline void TarRamFile::close() {
+	if (isOpen() && index == fs->growing) {
+		fs->freeze();
+	}
+	fs = NULL;
+	index = -1;
+	pos = 0;
+}
@@ -13,6 +13,8 @@
  * Minor fixes by Zsigmond Lorinczy, January, 2024.
  */
 
+#pragma once
+
 // Uncomment following definition to enable not flat namespace filesystems
 //#define TAR_MKDIR
 
@@ -27,6 +29,13 @@
 // Comment to remove callback support
 #define TAR_CALLBACK
 
+// Uncomment following definition to draw block buffers from a shared TarBlockPool, see Tar::pool()
+//#define TAR_POOL
+
+// Uncomment following definition to enable checkpoint()/resume() of interrupted extractions
+// The File type has to support flush(), seek() and truncate(), the FS type remove()
+//#define TAR_CHECKPOINT
+
 enum tar_state {
 	TAR_IDLE,
 	TAR_SHORT_READ,
@@ -34,18 +43,310 @@ enum tar_state {
 	TAR_FILE_EXTRACT,
 	TAR_SOURCE_EOF,
 	TAR_CHECKSUM_MISMACH,
-	TAR_DONE
+	TAR_DONE,
+	TAR_POOL_EMPTY,			// No free block in the pool, source untouched: call extract() later
+	TAR_RESUME_MISMATCH		// Archive differs from the resumed checkpoint, which was removed:
+					// open() the source from its start and extract() again
+};
+
+#ifdef TAR_POOL
+#include <atomic>
+
+// Fixed set of equally sized blocks, shared lock-free by many Tar objects.
+// A Tar holds one block while it is extracting: the first 512 bytes are its
+// block buffer, the rest is its write chunk if TarWriteChunk/chunk() fits in.
+class TarBlockPool {
+public:
+	TarBlockPool(void* mem, size_t blocksize, unsigned count) {	// count <= 32, blocksize >= 512
+		base = (char*)mem;
+		bsize = blocksize;
+		blocks = count > 32? 32: count;
+		if (blocksize < 512)
+			blocks = 0;		// Tar needs a whole block, acquire() always fails
+		used = 0;
+	}
+	char* acquire() {		// NULL if all blocks are in use
+		uint32_t u = used.load(std::memory_order_relaxed);
+		for (;;) {
+			unsigned i = 0;
+			while (i < blocks && (u & (1UL << i))) ++i;
+			if (i == blocks)
+				return NULL;
+			if (used.compare_exchange_weak(u, u | (1UL << i), std::memory_order_acquire, std::memory_order_relaxed))
+				return base + i * bsize;
+		}
+	}
+	void release(char* block) {
+		unsigned i = (block - base) / bsize;
+		used.fetch_and(~(uint32_t)(1UL << i), std::memory_order_release);
+	}
+	size_t blockSize() { return bsize; }
+	unsigned inUse() {
+		uint32_t u = used.load(std::memory_order_relaxed);
+		unsigned n = 0;
+		for (; u; u &= u - 1) ++n;
+		return n;
+	}
+private:
+	char* base;
+	size_t bsize;
+	unsigned blocks;
+	std::atomic<uint32_t> used;	// Bit i: block i is in use
 };
+#endif
 
 #ifdef TAR_CALLBACK
 typedef void (*cbTarData)(char* buff, size_t size);
 typedef bool (*cbTarProcess)(char* buff);
 typedef void (*cbTarEof)();
+// Same as above, but with a user supplied context pointer passed back as first argument
+typedef void (*cbTarDataCtx)(void* ctx, char* buff, size_t size);
+typedef bool (*cbTarProcessCtx)(void* ctx, char* buff);
+typedef void (*cbTarEofCtx)(void* ctx, const char* name, size_t size, tar_state state);
+
+// Progress report, see Tar::onProgress()
+struct tar_progress {
+	const char* name;		// Current member
+	size_t member_done;		// Bytes of the current member processed
+	size_t member_size;		// Size of the current member from its header
+	size_t archive_done;		// Bytes consumed from the source
+	size_t archive_size;		// Set by Tar::length(), 0 if unknown
+	unsigned percent;		// Of archive_size, 0 if unknown
+	unsigned long bytes_per_sec;	// Since open() or resume()
+	unsigned long eta_ms;		// Estimated time left, 0 if unknown
+};
+typedef void (*cbTarProgress)(void* ctx, const tar_progress* p);
+#endif
+
+// Default sink: does nothing. A sink is any class with the same three members,
+// given as second template parameter of Tar. Its calls are resolved at compile
+// time, so per-block work (hashing, Update.write, ...) can be inlined into the data loop.
+struct TarNullSink {
+	bool file(char* header) { (void)header; return true; }		// Return 'false' to skip file creation
+	void data(char* buff, size_t size) { (void)buff; (void)size; }	// Called for each data block
+	void eof(const char* name, size_t size, tar_state state) { (void)name; (void)size; (void)state; }
+};
+
+#ifdef TAR_CHECKPOINT
+#define TAR_CHECKPOINT_MAGIC 0x54434b34UL	// "TCK4"
+
+// Checkpoint record, followed by name_len bytes of the member's full path.
+// Saved alternately into 'path' and 'path~', resume() takes the valid one with the higher seq.
+struct tar_checkpoint {
+	uint32_t magic;
+	uint32_t seq;			// Incremented on each save
+	uint32_t crc;			// CRC32 of the record (with crc= 0) and the name
+	uint32_t archive_id;		// CRC32 of the archive's first header block
+	uint32_t archive_size;		// Tar::length() if it was set, 0 otherwise
+	uint32_t header_crc;		// CRC32 of the current member's header block
+	uint32_t archive_offset;	// Offset of the next block to read from the archive
+	uint32_t header_offset;		// Offset of the current member's header
+	uint32_t member_size;		// Size of the current member, 0 between members
+	uint32_t member_written;	// Bytes of the current member already processed
+	uint32_t digest;		// CRC32 of the processed bytes
+	uint32_t meta_size;		// Bytes of the metadata journal 'path+' this record covers
+	uint16_t name_len;
+	uint8_t extracting;		// Member was written to a file (not skipped)
+	uint8_t reserved;
+};
+
+// Entry of the metadata journal, followed by path_len bytes of the path.
+// Members finished before an interruption get their mode and mtime from it after resume().
+struct tar_meta_entry {
+	uint32_t mtime;
+	uint16_t mode;
+	uint16_t path_len;
+	uint8_t isdir;
+	uint8_t reserved[3];
+};
+
+// CRC32 (IEEE), a nibble at a time to keep the table small
+static inline uint32_t tar_crc32(uint32_t crc, const uint8_t* p, size_t n) {
+	static const uint32_t tab[16] = {
+		0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+		0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+		0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+		0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+	};
+	crc = ~crc;
+	while (n--) {
+		crc ^= *p++;
+		crc = (crc >> 4) ^ tab[crc & 0x0f];
+		crc = (crc >> 4) ^ tab[crc & 0x0f];
+	}
+	return ~crc;
+}
 #endif
 
+template <typename X>
+X& tar_declref();	// Only used in decltype(), never defined
+
+// Optional hooks, called only if the File type has them
+template <typename F>
+static inline auto tar_reserve(F* f, size_t size, int) -> decltype(f->reserve(size)) {
+	return f->reserve(size);	// Preallocate 'size' bytes, 'false' if they don't fit
+}
+template <typename F>
+static inline bool tar_reserve(F* f, size_t size, long) {
+	(void)f;
+	(void)size;
+	return true;
+}
+
+// Optional remove(path) of the FS type, 'false' if there is none
+template <typename X>
+static inline auto tar_remove(X* fs, const char* path, int) -> decltype(fs->remove(path), bool()) {
+	fs->remove(path);
+	return true;
+}
+template <typename X>
+static inline bool tar_remove(X* fs, const char* path, long) {
+	(void)fs;
+	(void)path;
+	return false;
+}
+
+// Optional metadata hooks of the FS type: int chmod(path, mode), int utime(path, mtime), 0 on success
+template <typename X>
+static inline auto tar_chmod(X* fs, const char* path, int mode, int) -> decltype(fs->chmod(path, mode), bool()) {
+	return fs->chmod(path, mode) == 0;
+}
+template <typename X>
+static inline bool tar_chmod(X* fs, const char* path, int mode, long) {
+	(void)fs;
+	(void)path;
+	(void)mode;
+	return true;
+}
+template <typename X>
+static inline auto tar_utime(X* fs, const char* path, uint32_t mtime, int) -> decltype(fs->utime(path, mtime), bool()) {
+	return fs->utime(path, mtime) == 0;
+}
+template <typename X>
+static inline bool tar_utime(X* fs, const char* path, uint32_t mtime, long) {
+	(void)fs;
+	(void)path;
+	(void)mtime;
+	return true;
+}
+template <typename X>
+static constexpr auto tar_has_chmod(int) -> decltype(tar_declref<X>().chmod("", 0), bool()) {
+	return true;
+}
+template <typename X>
+static constexpr bool tar_has_chmod(long) {
+	return false;
+}
+template <typename X>
+static constexpr auto tar_has_utime(int) -> decltype(tar_declref<X>().utime("", 0), bool()) {
+	return true;
+}
+template <typename X>
+static constexpr bool tar_has_utime(long) {
+	return false;
+}
+
+// Metadata of an extracted member, applied after the archive
+struct tar_meta {
+	char* path;
+	uint32_t mtime;
+	uint16_t mode;
+	uint8_t depth;			// Number of '/' in path
+	uint8_t isdir;
+};
+
+// Tar header parsing, shared by Tar and TarFS
+class TarHeader {
+public:
+	static int parseoct(const char *p, size_t n);		// Parse an octal number, ignoring leading and trailing nonsense.
+	static int is_end_of_archive(const char *p);		// Returns true if this is 512 zero bytes.
+	static int verify_checksum(const char *p);		// Verify the tar checksum.
+};
+
+inline int TarHeader::parseoct(const char *p, size_t n)
+{
+	int i = 0;
+
+	while (*p < '0' || *p > '7') {
+		++p;
+		--n;
+	}
+	while (*p >= '0' && *p <= '7' && n > 0) {
+		i *= 8;
+		i += *p - '0';
+		++p;
+		--n;
+	}
+	return (i);
+}
+
+inline int TarHeader::is_end_of_archive(const char *p)
+{
+	int n;
+	for (n = 511; n >= 0; --n)
+		if (p[n] != '\0')
+			return (0);
+	return (1);
+}
+
+inline int TarHeader::verify_checksum(const char *p)
+{
+	int n, u = 0;
+	for (n = 0; n < 512; ++n) {
+		if (n < 148 || n > 155)
+			/* Standard tar checksum adds unsigned bytes. */
+			u += ((unsigned char *)p)[n];
+		else
+			u += 0x20;
+
+	}
+	return (u == parseoct(p + 148, 8));
+}
+
+// Member name index, shared by TarFS and TarRamFS
+class TarNames {
+public:
+	static uint32_t hash(const char* s);			// FNV-1a
+	template <typename A>
+	static int lookup(A at, size_t count, const char* name);	// Index of the newest entry 'at(i)' with 'name'
+								// (NULL if removed) and 'hash' matching, -1 if none
+};
+
+inline uint32_t TarNames::hash(const char* s)
+{
+	uint32_t h = 2166136261UL;
+	while (*s) {
+		h ^= (uint8_t)*s++;
+		h *= 16777619UL;
+	}
+	return h;
+}
+
+template <typename A>
+int TarNames::lookup(A at, size_t count, const char* name)
+{
+	uint32_t h = hash(name);
+	for (int i = (int)count - 1; i >= 0; --i) {	// Last one wins, as when extracting
+		if (at(i)->name && at(i)->hash == h && strcmp(at(i)->name, name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+// Size of the chunks file data is collected into before writing, per FS type.
+// Specialize it with the flash page or erase block size of your filesystem,
+// e.g. template <> struct TarWriteChunk<FS> { static const size_t size = 4096; };
+// 512 or less writes each block directly.
 template <typename T>
-class Tar {
+struct TarWriteChunk {
+	static const size_t size = 512;
+};
+
+template <typename T, typename S = TarNullSink>
+class Tar : private TarHeader {
 public:
+	typedef decltype(tar_declref<T>().open("", "")) FileType;	// File type returned by T::open()
+
 	Tar(T* dst, int pmsglevel= 1) {
 		FSC = dst;
 		pathprefix = NULL;
@@ -53,58 +354,265 @@ public:
 	}
 	~Tar() {
 		if (pathprefix) free(pathprefix);
+		if (fullpath) free(fullpath);
+		if (f != NULL) {
+			if (f->isOpen()) {
+				flush_out();
+				f->close();
+			}
+			delete f;
+		}
+		#ifdef TAR_POOL
+		release_buff();
+		if (buff) free(buff);
+		#endif
+		if (chunkbuf) free(chunkbuf);
+		free_meta();
+		#ifdef TAR_CHECKPOINT
+		if (ckpath) free(ckpath);
+		#endif
 	}
 	void dest(const char* path);	// Set directory extract to. tar -C
 	void open(Stream* src);		// Source stream. Can use (Stream*)File as source
 	void extract();			// Extract a tar archive
+	void chunk(size_t size);	// Overrides TarWriteChunk<T>::size
+	tar_state state() { return _state; }	// State after the last extract()
+	#ifdef TAR_POOL
+	bool pool(TarBlockPool* p);	// Draw the block buffer from a shared pool, held only while extracting
+					// 'false' while a partial block is held: call it before open() or after extract() completes
+	#endif
+	void applyMeta();		// Apply recorded modes and mtimes (files, then directories deepest first)
+					// extract() calls it at the end-of-archive marker, or when the source ends between members
+	#ifdef TAR_CHECKPOINT
+	void checkpoint(const char* path, size_t interval);	// Save progress into 'path' every 'interval' archive bytes
+	size_t resume();		// Call after open(): loads the checkpoint and returns the archive offset
+					// the source has to be positioned to (seek or range request) before extract().
+					// Reads the first header from the source to check the checkpoint belongs
+					// to this archive; if not, it is discarded and the offset after that header
+					// (where the source already is) is returned.
+					// A member in progress is continued from its header: extract() reads the
+					// header and the data already written again and compares their CRCs with
+					// the checkpoint, else it stops with TAR_RESUME_MISMATCH. Members finished
+					// before the checkpoint are not checked again.
+					// Under TAR_POOL, state() is TAR_POOL_EMPTY if no block was free: nothing
+					// was read and the checkpoint is kept, call resume() again later.
+					// Modes and mtimes of the members extracted so far are journaled into
+					// 'path+' with each save, so applyMeta() after a resume covers them too.
+	#endif
 	#ifdef TAR_CALLBACK
 	void onFile(cbTarProcess cb);	// Sets callback that executed on each file in archive.
 	void onData(cbTarData cb);	// Sets callback that executed on each 512 bytes data block in file
 	void onEof(cbTarEof cb);	// Sets callback that executed on each file end
+	void onFile(cbTarProcessCtx cb, void* ctx);	// Same as above, 'ctx' is passed back to the callback
+	void onData(cbTarDataCtx cb, void* ctx);
+	void onEof(cbTarEofCtx cb, void* ctx);		// Also gets member name, size and final state
+	void sink(S* s);		// Sets sink object. See TarNullSink
+	void onProgress(cbTarProgress cb, void* ctx, unsigned long interval_ms, size_t interval_bytes = 0);
+					// Progress callback, called when 'interval_ms' or 'interval_bytes' passed (0: not checked)
+					// and at the end of the archive (or of the source between members)
+	void length(size_t size);	// Archive length if known, for percent and ETA
 	#endif
 private:
 	int msglevel;			// Note: it has no use if 'TAR_SILENT' is defined
 	char* pathprefix;		// Stores filename prefix to be added to each file/directory
-	int parseoct(const char *p, size_t n);		// Parse an octal number, ignoring leading and trailing nonsense.
-	int is_end_of_archive(const char *p);		// Returns true if this is 512 zero bytes.
 	#ifdef TAR_MKDIR
 	void create_dir(char *pathname, int mode);	// Create a directory, including parent directories as necessary.
 	#endif
-	File *create_file(char *pathname);		// Create a file, including parent directory as necessary.
-	int verify_checksum(const char *p);		// Verify the tar checksum.
+	FileType *create_file(char *pathname);		// Create a file, including parent directory as necessary.
 	T* FSC;						// FS object
 	Stream* source;					// Source stream
 	void *emalloc(size_t size);
+	bool write_out(const char *p, size_t n);	// Write member data through the chunk buffer
+	bool flush_out();				// Write the collected chunk
+	void fail_write();				// Report and drop the current file after a failed write
+	static const bool keepmeta = tar_has_chmod<T>(0) || tar_has_utime<T>(0);	// Record metadata only if T can apply it
+	void keep_meta();				// Move fullpath and the meta_* fields into the table
+	tar_meta* add_meta(char* path);			// New entry owning 'path', NULL if out of memory
+	void free_meta();
+	tar_meta* metatab = NULL;
+	size_t metacount = 0;
+	size_t metaalloc = 0;
+	bool meta_record = false;			// Current member has to be recorded
+	bool meta_isdir = false;
+	uint16_t meta_mode = 0;
+	uint32_t meta_mtime = 0;
+	size_t chunksize = TarWriteChunk<T>::size;
+	char* chunkbuf = NULL;				// NULL: blocks are written directly
+	size_t chunk_fill = 0;
+	size_t chunk_limit = 0;				// Flush when chunk_fill reaches it, keeps chunks aligned in the file
+	size_t file_written = 0;			// Bytes of the current member passed to f->write()
+	#ifdef TAR_CHECKPOINT
+	void save_checkpoint();				// Write the checkpoint record if 'ckinterval' bytes passed
+	bool verify_partial(FileType *pf, size_t len, uint32_t crc);	// Check the first 'len' bytes of a partial file
+	bool load_checkpoint(uint8_t slot, tar_checkpoint* ck, char** name);	// Read and check one slot
+	size_t load_resume();				// resume() with the block buffer held
+	void remove_checkpoint();			// Both slots and the journal
+	void save_meta();				// Append the entries not in the journal yet
+	void load_meta(size_t size);			// Read back 'size' bytes of the journal, drop the rest
+	const char* ck_slot(uint8_t slot) {		// File name of slot 0 or 1
+		ckpath[cklen] = slot? '~': '\0';
+		return ckpath;
+	}
+	const char* ck_journal() {			// File name of the metadata journal
+		ckpath[cklen] = '+';
+		return ckpath;
+	}
+	char* ckpath = NULL;				// Checkpoint file, NULL if disabled. Room for the '~' or '+' suffix
+	size_t cklen = 0;
+	uint32_t ckseq = 0;				// seq of the last saved or loaded record, 0 if none
+	uint8_t ckslot = 0;				// Slot to write next, the other one holds the last record
+	uint32_t archive_id = 0;			// CRC32 of the first header block
+	size_t ckinterval = 0;
+	size_t cklast = 0;				// archive_offset at the last save
+	size_t header_offset = 0;			// archive_offset of the current member's header
+	uint32_t digest = 0;				// CRC32 of the current member's processed bytes
+	uint32_t header_crc = 0;			// CRC32 of the current member's header block
+	size_t ckcheck = 0;				// After resume(): bytes from header_offset still to compare
+	size_t ckmetasize = 0;				// Bytes in the journal
+	size_t ckmetasaved = 0;				// Entries of metatab in the journal
+	uint32_t ckheader = 0;				// Expected header_crc and digest of these bytes
+	uint32_t ckdigest = 0;
+	#endif
 	#ifdef TAR_CALLBACK
 	cbTarProcess cbProcess = NULL;			// bool cbExclude(filename) calback. Return 'false' means skip file creation then
 	cbTarData cbData = NULL;			// cbNull(data, size) callback. Called for each data block if file creation was skipped.
 	cbTarEof cbEof = NULL;				// cnEof() callback. Called on end of file if file was skipped or not.
+	cbTarProcessCtx cbProcessCtx = NULL;		// Context-carrying variants of the above
+	cbTarDataCtx cbDataCtx = NULL;
+	cbTarEofCtx cbEofCtx = NULL;
+	void* ctxProcess = NULL;
+	void* ctxData = NULL;
+	void* ctxEof = NULL;
+	S* dataSink = NULL;				// Sink object, called after the callbacks
+	cbTarProgress cbProgress = NULL;
+	void* ctxProgress = NULL;
+	unsigned long prog_ims = 0;			// Reporting intervals
+	size_t prog_ibytes = 0;
+	size_t archive_size = 0;
+	unsigned long prog_start = 0;			// millis() and archive_offset at open() or resume()
+	size_t prog_base = 0;
+	unsigned long prog_last_ms = 0;			// At the last report
+	size_t prog_last_bytes = 0;
+	void progress(bool end);			// Call cbProgress if an interval passed or at the end of the archive
 	#endif
+	const char* member_name();			// Current member without pathprefix
+	#ifdef TAR_POOL
+	bool acquire_buff();				// Get a block from the pool, 'false' if there is none
+	void release_buff();				// Give it back
+	TarBlockPool* blockpool = NULL;
+	char* pooled = NULL;				// Block held from blockpool
+	char* buff = NULL;				// Points into 'pooled', or own buffer if there is no pool
+	#else
 	char buff[512];
-	File *f = NULL;
+	#endif
+	char* fullpath = NULL;				// pathprefix + name of the current member
+	size_t member_size = 0;				// Size of the current member from its header
+	FileType *f = NULL;
 	size_t bytes_read = 0;
 	size_t pending_filesize = 0;
+	size_t archive_offset = 0;			// Bytes consumed from the source
 	tar_state _state = TAR_IDLE;
 };
 #ifdef TAR_CALLBACK
-template <typename T>
-void Tar<T>::onFile(cbTarProcess cb){
+template <typename T, typename S>
+void Tar<T, S>::onFile(cbTarProcess cb){
 	cbProcess = cb;
 }
 
-template <typename T>
-void Tar<T>::onData(cbTarData cb){
+template <typename T, typename S>
+void Tar<T, S>::onData(cbTarData cb){
 	cbData = cb;
 }
 
-template <typename T>
-void Tar<T>::onEof(cbTarEof cb){
+template <typename T, typename S>
+void Tar<T, S>::onEof(cbTarEof cb){
 	cbEof = cb;
 }
+
+template <typename T, typename S>
+void Tar<T, S>::onFile(cbTarProcessCtx cb, void* ctx){
+	cbProcessCtx = cb;
+	ctxProcess = ctx;
+}
+
+template <typename T, typename S>
+void Tar<T, S>::onData(cbTarDataCtx cb, void* ctx){
+	cbDataCtx = cb;
+	ctxData = ctx;
+}
+
+template <typename T, typename S>
+void Tar<T, S>::onEof(cbTarEofCtx cb, void* ctx){
+	cbEofCtx = cb;
+	ctxEof = ctx;
+}
+
+template <typename T, typename S>
+void Tar<T, S>::sink(S* s){
+	dataSink = s;
+}
+
+template <typename T, typename S>
+void Tar<T, S>::onProgress(cbTarProgress cb, void* ctx, unsigned long interval_ms, size_t interval_bytes){
+	cbProgress = cb;
+	ctxProgress = ctx;
+	prog_ims = interval_ms;
+	prog_ibytes = interval_bytes;
+}
+
+template <typename T, typename S>
+void Tar<T, S>::length(size_t size){
+	archive_size = size;
+}
+
+template <typename T, typename S>
+void Tar<T, S>::progress(bool end){
+	if (cbProgress == NULL)
+		return;
+	unsigned long now = 0;
+	if (!end) {
+		bool force = false;
+		if (prog_ibytes && archive_offset - prog_last_bytes >= prog_ibytes) {
+			force = true;
+		} else if (prog_ims) {
+			now = millis();
+			force = now - prog_last_ms >= prog_ims;
+		}
+		if (!force)
+			return;
+	}
+	if (now == 0) now = millis();
+	tar_progress p;
+	p.name = member_name();
+	p.member_size = member_size;
+	p.member_done = member_size - pending_filesize;
+	p.archive_done = archive_offset;
+	p.archive_size = archive_size;
+	p.percent = 0;
+	p.eta_ms = 0;
+	unsigned long elapsed = now - prog_start;
+	size_t done = archive_offset - prog_base;
+	p.bytes_per_sec = elapsed? (unsigned long)((unsigned long long)done * 1000 / elapsed): 0;
+	if (end) {
+		p.percent = 100;
+	} else if (archive_size) {
+		p.percent = archive_offset >= archive_size? 100: (unsigned)((unsigned long long)archive_offset * 100 / archive_size);
+		if (p.bytes_per_sec && archive_offset < archive_size)
+			p.eta_ms = (unsigned long)((unsigned long long)(archive_size - archive_offset) * 1000 / p.bytes_per_sec);
+	}
+	prog_last_ms = now;
+	prog_last_bytes = archive_offset;
+	cbProgress(ctxProgress, &p);
+}
 #endif
 
-template <typename T>
-void Tar<T>::dest(const char* path){
+template <typename T, typename S>
+const char* Tar<T, S>::member_name(){
+	return fullpath? fullpath + (pathprefix? strlen(pathprefix): 0): "";
+}
+
+template <typename T, typename S>
+void Tar<T, S>::dest(const char* path){
 	if (pathprefix) {
 		free (pathprefix);
 		pathprefix= NULL;
@@ -117,44 +625,547 @@ void Tar<T>::dest(const char* path){
 	}
 }
 
-template <typename T>
-void Tar<T>::open(Stream* src){
+template <typename T, typename S>
+void Tar<T, S>::open(Stream* src){
 	source = src;
+	if (f != NULL) {
+		if (f->isOpen()) f->close();
+		delete f;
+		f = NULL;
+	}
+	if (fullpath) {
+		free(fullpath);
+		fullpath = NULL;
+	}
+	chunk_fill = 0;
+	file_written = 0;
+	#ifdef TAR_POOL
+	release_buff();
+	#endif
+	free_meta();
 	pending_filesize = 0;
+	bytes_read = 0;
+	archive_offset = 0;
 	_state = TAR_IDLE;
+	#ifdef TAR_CALLBACK
+	prog_start = prog_last_ms = millis();
+	prog_base = prog_last_bytes = 0;
+	#endif
+	#ifdef TAR_CHECKPOINT
+	cklast = 0;
+	ckseq = 0;
+	ckcheck = 0;
+	archive_id = 0;
+	#endif
 }
 
-template <typename T>
-int Tar<T>::parseoct(const char *p, size_t n)
-{
-	int i = 0;
+template <typename T, typename S>
+void Tar<T, S>::keep_meta(){
+	meta_record = false;
+	tar_meta* m = add_meta(fullpath);
+	if (m == NULL)
+		return;
+	m->isdir = meta_isdir;
+	m->mode = meta_mode;
+	m->mtime = meta_mtime;
+	fullpath = NULL;
+}
 
-	while (*p < '0' || *p > '7') {
-		++p;
-		--n;
+template <typename T, typename S>
+tar_meta* Tar<T, S>::add_meta(char* path){
+	if (metacount == metaalloc) {
+		size_t n = metaalloc? 2 * metaalloc: 16;
+		tar_meta* p = (tar_meta*)realloc(metatab, n * sizeof(tar_meta));
+		if (p == NULL) {
+			#ifndef TAR_SILENT
+			if (msglevel>=1) {
+				Serial.println("Memory allocation error, metadata not kept");
+			}
+			#endif
+			return NULL;
+		}
+		metatab = p;
+		metaalloc = n;
 	}
-	while (*p >= '0' && *p <= '7' && n > 0) {
-		i *= 8;
-		i += *p - '0';
-		++p;
-		--n;
+	tar_meta* m = &metatab[metacount++];
+	size_t len = strlen(path);
+	while (len >= 2 && path[len-1] == '/')
+		path[--len] = '\0';
+	m->depth = 0;
+	for (const char *p = path; *p; ++p)
+		if (*p == '/' && m->depth < 255) ++m->depth;
+	m->path = path;
+	return m;
+}
+
+template <typename T, typename S>
+void Tar<T, S>::free_meta(){
+	for (size_t i = 0; i < metacount; ++i)
+		free(metatab[i].path);
+	if (metatab) free(metatab);
+	metatab = NULL;
+	metacount = metaalloc = 0;
+	#ifdef TAR_CHECKPOINT
+	ckmetasaved = 0;
+	#endif
+}
+
+static int tar_meta_order(const void *a, const void *b) {
+	/* Files first, then directories deepest first */
+	const tar_meta *x = (const tar_meta *)a, *y = (const tar_meta *)b;
+	int kx = x->isdir? 256 - x->depth: 0;
+	int ky = y->isdir? 256 - y->depth: 0;
+	return kx - ky;
+}
+
+template <typename T, typename S>
+void Tar<T, S>::applyMeta(){
+	/* Directories last, so a read-only or touched directory is not modified afterwards */
+	if (metacount > 1)
+		qsort(metatab, metacount, sizeof(tar_meta), tar_meta_order);
+	for (size_t i = 0; i < metacount; ++i) {
+		tar_meta* m = &metatab[i];
+		bool ok = tar_chmod(FSC, m->path, m->mode, 0);
+		ok = tar_utime(FSC, m->path, m->mtime, 0) && ok;
+		#ifndef TAR_SILENT
+		if (!ok && msglevel>=1) {
+			Serial.print("Could not set mode/mtime of ");
+			Serial.println(m->path);
+		}
+		#endif
 	}
-	return (i);
+	free_meta();
 }
 
-template <typename T>
-int Tar<T>::is_end_of_archive(const char *p)
-{
-	int n;
-	for (n = 511; n >= 0; --n)
-		if (p[n] != '\0')
-			return (0);
-	return (1);
+#ifdef TAR_POOL
+template <typename T, typename S>
+bool Tar<T, S>::pool(TarBlockPool* p){
+	if (p == blockpool)
+		return true;
+	if (bytes_read > 0)
+		return false;		// The block holds part of a header or data block
+	if (f != NULL && f->isOpen() && !flush_out())
+		fail_write();
+	release_buff();
+	if (buff) {
+		free(buff);
+		buff = NULL;
+	}
+	blockpool = p;
+	return true;
+}
+
+template <typename T, typename S>
+bool Tar<T, S>::acquire_buff(){
+	if (blockpool == NULL) {
+		if (buff == NULL)
+			buff = (char*)emalloc(512);
+		return buff != NULL;
+	}
+	if (pooled == NULL) {
+		pooled = blockpool->acquire();
+		if (pooled == NULL)
+			return false;
+		buff = pooled;
+		if (chunkbuf == NULL && chunksize > 512 && blockpool->blockSize() >= 512 + chunksize)
+			chunkbuf = pooled + 512;
+	}
+	return true;
+}
+
+template <typename T, typename S>
+void Tar<T, S>::release_buff(){
+	if (pooled != NULL) {
+		if (chunkbuf == pooled + 512)
+			chunkbuf = NULL;
+		blockpool->release(pooled);
+		pooled = NULL;
+		buff = NULL;
+	}
+}
+#endif
+
+template <typename T, typename S>
+void Tar<T, S>::chunk(size_t size){
+	if (size < 512) size = 512;
+	if (size == chunksize)
+		return;
+	if (f != NULL && f->isOpen() && !flush_out())	// Buffered data of an open member goes out first
+		fail_write();
+	#ifdef TAR_POOL
+	if (pooled && chunkbuf == pooled + 512) {
+		chunkbuf = NULL;		// Taken from the pool block, not allocated
+	}
+	#endif
+	if (chunkbuf) {
+		free(chunkbuf);
+		chunkbuf = NULL;
+	}
+	chunksize = size;
+	chunk_fill = 0;
+	chunk_limit = chunksize - file_written % chunksize;
+	#ifdef TAR_POOL
+	if (pooled && chunksize > 512 && blockpool->blockSize() >= 512 + chunksize)
+		chunkbuf = pooled + 512;
+	#endif
+}
+
+template <typename T, typename S>
+bool Tar<T, S>::write_out(const char *p, size_t n){
+	if (chunkbuf == NULL) {
+		file_written += n;
+		return f->write((uint8_t*)p, n) == n;
+	}
+	while (n > 0) {
+		size_t m = chunk_limit - chunk_fill;
+		if (m > n) m = n;
+		memcpy(chunkbuf + chunk_fill, p, m);
+		chunk_fill += m;
+		p += m;
+		n -= m;
+		if (chunk_fill == chunk_limit && !flush_out())
+			return false;
+	}
+	return true;
+}
+
+template <typename T, typename S>
+bool Tar<T, S>::flush_out(){
+	size_t n = chunk_fill;
+	chunk_fill = 0;
+	file_written += n;
+	chunk_limit = chunksize - file_written % chunksize;	// Also after a flush in mid-chunk
+	return n == 0 || f->write((uint8_t*)chunkbuf, n) == n;
+}
+
+template <typename T, typename S>
+void Tar<T, S>::fail_write(){
+	#ifndef TAR_SILENT
+	if (msglevel>=1) {
+		Serial.println(" - Failed write");
+	}
+	#endif
+	_state = TAR_WRITE_ERROR;
+	chunk_fill = 0;
+	f->close();
+	delete f;
+	f = NULL;
+}
+
+#ifdef TAR_CHECKPOINT
+template <typename T, typename S>
+void Tar<T, S>::checkpoint(const char* path, size_t interval){
+	if (ckpath) {
+		free (ckpath);
+		ckpath= NULL;
+	}
+	if (path && *path) {
+		cklen = strlen(path);
+		ckpath = (char*)emalloc (cklen + 2);
+		if (ckpath != NULL) {
+			strcpy (ckpath, path);
+			ckpath[cklen + 1] = '\0';
+		}
+	}
+	ckinterval = interval < 512? 512: interval;
+}
+
+template <typename T, typename S>
+void Tar<T, S>::save_checkpoint(){
+	if (ckpath == NULL || ckcheck > 0 || archive_offset - cklast < ckinterval)
+		return;
+	tar_checkpoint ck;
+	memset(&ck, 0, sizeof(ck));
+	ck.magic = TAR_CHECKPOINT_MAGIC;
+	ck.archive_id = archive_id;
+	#ifdef TAR_CALLBACK
+	ck.archive_size = archive_size;
+	#endif
+	ck.archive_offset = archive_offset;
+	ck.header_offset = pending_filesize? header_offset: archive_offset;
+	ck.header_crc = pending_filesize? header_crc: 0;
+	ck.member_size = pending_filesize? member_size: 0;
+	ck.member_written = pending_filesize? member_size - pending_filesize: 0;
+	ck.digest = pending_filesize? digest: 0;
+	ck.extracting = (pending_filesize && f != NULL && f->isOpen())? 1: 0;
+	ck.name_len = (pending_filesize && fullpath)? strlen(fullpath): 0;
+	if (f != NULL && f->isOpen()) {
+		if (!flush_out()) {
+			fail_write();
+		} else {
+			f->flush();	// Data on the FS has to reach the checkpointed length
+		}
+	}
+	if (ckseq == 0) {
+		/* New extraction: records of an earlier one must not outrank ours */
+		FSC->remove(ck_slot(0));
+		FSC->remove(ck_slot(1));
+		FSC->remove(ck_journal());
+		ckslot = 0;
+		ckmetasize = 0;
+	}
+	save_meta();		// Before the record that covers it
+	ck.meta_size = ckmetasize;
+	ck.seq = ckseq + 1;
+	ck.crc = tar_crc32(0, (const uint8_t*)&ck, sizeof(ck));
+	if (ck.name_len) {
+		ck.crc = tar_crc32(ck.crc, (const uint8_t*)fullpath, ck.name_len);
+	}
+	/* Overwrite the older slot only, a power loss meanwhile leaves the last record intact */
+	FileType cf = FSC->open(ck_slot(ckslot), "w");
+	if (!cf) {
+		#ifndef TAR_SILENT
+		if (msglevel>=1) {
+			Serial.print("Could not write checkpoint ");
+			Serial.println(ckpath);
+		}
+		#endif
+		return;
+	}
+	cf.write((uint8_t*)&ck, sizeof(ck));
+	if (ck.name_len) {
+		cf.write((uint8_t*)fullpath, ck.name_len);
+	}
+	cf.close();
+	ckseq = ck.seq;
+	ckslot ^= 1;
+	cklast = archive_offset;
+}
+
+template <typename T, typename S>
+void Tar<T, S>::remove_checkpoint(){
+	FSC->remove(ck_slot(0));
+	FSC->remove(ck_slot(1));
+	FSC->remove(ck_journal());
+	ckseq = 0;
+	ckslot = 0;
+	ckmetasize = 0;
+}
+
+template <typename T, typename S>
+void Tar<T, S>::save_meta(){
+	if (ckmetasaved >= metacount)
+		return;
+	FileType jf = FSC->open(ck_journal(), "a");
+	if (!jf)
+		return;			// Tried again at the next save
+	for (; ckmetasaved < metacount; ++ckmetasaved) {
+		tar_meta* m = &metatab[ckmetasaved];
+		tar_meta_entry e;
+		memset(&e, 0, sizeof(e));
+		e.mtime = m->mtime;
+		e.mode = m->mode;
+		e.isdir = m->isdir;
+		e.path_len = strlen(m->path);
+		if (jf.write((uint8_t*)&e, sizeof(e)) != sizeof(e)
+		 || jf.write((uint8_t*)m->path, e.path_len) != e.path_len)
+			break;		// The record covers only what was written completely
+		ckmetasize += sizeof(e) + e.path_len;
+	}
+	jf.close();
+}
+
+template <typename T, typename S>
+void Tar<T, S>::load_meta(size_t size){
+	ckmetasize = 0;
+	if (size == 0) {
+		FSC->remove(ck_journal());
+		return;
+	}
+	FileType jf = FSC->open(ck_journal(), "r+");
+	if (!jf)
+		return;
+	tar_meta_entry e;
+	while (ckmetasize + sizeof(e) <= size
+	    && jf.readBytes((char*)&e, sizeof(e)) == sizeof(e)
+	    && ckmetasize + sizeof(e) + e.path_len <= size) {
+		char* path = (char*)emalloc(e.path_len + 1);
+		if (path == NULL || jf.readBytes(path, e.path_len) != e.path_len) {
+			if (path) free(path);
+			break;
+		}
+		path[e.path_len] = '\0';
+		tar_meta* m = add_meta(path);
+		if (m == NULL) {
+			free(path);
+			break;
+		}
+		m->isdir = e.isdir;
+		m->mode = e.mode;
+		m->mtime = e.mtime;
+		ckmetasize += sizeof(e) + e.path_len;
+	}
+	jf.truncate(ckmetasize);	// Entries appended after the record are written again
+	jf.close();
+	ckmetasaved = metacount;
+}
+
+template <typename T, typename S>
+bool Tar<T, S>::load_checkpoint(uint8_t slot, tar_checkpoint* ck, char** name){
+	*name = NULL;
+	FileType cf = FSC->open(ck_slot(slot), "r");
+	if (!cf)
+		return false;
+	bool ok = cf.readBytes((char*)ck, sizeof(*ck)) == sizeof(*ck)
+		&& ck->magic == TAR_CHECKPOINT_MAGIC;
+	if (ok && ck->name_len) {
+		*name = (char*)emalloc(ck->name_len + 1);
+		ok = *name != NULL && cf.readBytes(*name, ck->name_len) == ck->name_len;
+		if (ok) (*name)[ck->name_len] = '\0';
+	}
+	cf.close();
+	if (ok) {
+		uint32_t crc = ck->crc;
+		ck->crc = 0;
+		uint32_t u = tar_crc32(0, (const uint8_t*)ck, sizeof(*ck));
+		if (ck->name_len) {
+			u = tar_crc32(u, (const uint8_t*)*name, ck->name_len);
+		}
+		ok = u == crc;		// Torn or partial write otherwise
+	}
+	if (!ok && *name) {
+		free(*name);
+		*name = NULL;
+	}
+	return ok;
+}
+
+template <typename T, typename S>
+bool Tar<T, S>::verify_partial(FileType *pf, size_t len, uint32_t crc){
+	uint32_t u = 0;
+	while (len > 0) {
+		size_t n = len < 512? len: 512;
+		if (pf->readBytes(buff, n) != n)
+			break;
+		u = tar_crc32(u, (const uint8_t*)buff, n);
+		len -= n;
+	}
+	return len == 0 && u == crc;
+}
+
+template <typename T, typename S>
+size_t Tar<T, S>::resume(){
+	if (ckpath == NULL)
+		return 0;
+	#ifdef TAR_POOL
+	if (!acquire_buff()) {
+		_state = TAR_POOL_EMPTY;	// Nothing read, checkpoint kept: call resume() again later
+		return 0;
+	}
+	#endif
+	_state = TAR_IDLE;
+	size_t offs = load_resume();
+	#ifdef TAR_POOL
+	if (bytes_read == 0)
+		release_buff();
+	#endif
+	return offs;
 }
 
+template <typename T, typename S>
+size_t Tar<T, S>::load_resume(){
+	tar_checkpoint ck, ck1;
+	char *name, *name1;
+	bool ok = load_checkpoint(0, &ck, &name);
+	if (load_checkpoint(1, &ck1, &name1)) {
+		if (!ok || ck1.seq > ck.seq) {
+			if (name) free(name);
+			ck = ck1;
+			name = name1;
+			ok = true;
+			ckslot = 0;
+		} else {
+			if (name1) free(name1);
+			ckslot = 1;
+		}
+	} else {
+		ckslot = 1;
+	}
+	if (!ok)
+		return 0;
+	/* The checkpoint has to belong to this archive: compare its first header */
+	size_t n = 0, r;
+	while (n < 512 && (r = source->readBytes(buff + n, 512 - n)) > 0)
+		n += r;
+	bool same = n == 512 && tar_crc32(0, (const uint8_t*)buff, 512) == ck.archive_id;
+	#ifdef TAR_CALLBACK
+	if (archive_size && ck.archive_size && archive_size != ck.archive_size)
+		same = false;
+	#endif
+	if (!same) {
+		#ifndef TAR_SILENT
+		if (msglevel>=1) {
+			Serial.println("Checkpoint belongs to another archive, discarded");
+		}
+		#endif
+		if (name) free(name);
+		remove_checkpoint();
+		bytes_read = n;		// extract() goes on with the header read
+		archive_offset = cklast = n;
+		return n;
+	}
+	archive_id = ck.archive_id;
+	ckseq = ck.seq;
+	load_meta(ck.meta_size);
+	if (ck.member_size == 0) {
+		if (name) free(name);
+		archive_offset = cklast = ck.archive_offset;
+		#ifdef TAR_CALLBACK
+		prog_base = prog_last_bytes = archive_offset;
+		#endif
+		return archive_offset;
+	}
+	if (ck.extracting) {
+		/* Keep the partial file only if it still holds what the checkpoint says */
+		FileType *pf = new FileType();
+		*pf = FSC->open(name, "r+");
+		if (!pf->isOpen() || !verify_partial(pf, ck.member_written, ck.digest)
+		 || !pf->truncate(ck.member_written) || !pf->seek(ck.member_written)) {
+			#ifndef TAR_SILENT
+			if (msglevel>=2) {
+				Serial.print("Partial file does not match checkpoint, restarting ");
+				Serial.println(name);
+			}
+			#endif
+			if (pf->isOpen()) pf->close();
+			delete pf;
+			free(name);
+			header_offset = ck.header_offset;	// Its header is still checked
+			ckheader = ck.header_crc;
+			ckcheck = 512;
+			archive_offset = cklast = ck.header_offset;
+			#ifdef TAR_CALLBACK
+			prog_base = prog_last_bytes = archive_offset;
+			#endif
+			return archive_offset;
+		}
+		f = pf;
+		chunk_fill = 0;
+		file_written = ck.member_written;
+		chunk_limit = chunksize - file_written % chunksize;
+	}
+	fullpath = name;
+	member_size = ck.member_size;
+	pending_filesize = ck.member_size - ck.member_written;
+	header_offset = ck.header_offset;
+	header_crc = ck.header_crc;
+	/* Continue from the header, extract() compares it and the written data first */
+	ckheader = ck.header_crc;
+	ckdigest = ck.digest;
+	ckcheck = 512 + ck.member_written;
+	digest = 0;
+	archive_offset = cklast = ck.header_offset;
+	#ifdef TAR_CALLBACK
+	prog_base = prog_last_bytes = archive_offset;
+	#endif
+	_state = TAR_FILE_EXTRACT;
+	return archive_offset;
+}
+#endif
+
 #ifdef TAR_MKDIR
-template <typename T>
-void Tar<T>::create_dir(char *pathname, int mode)
+template <typename T, typename S>
+void Tar<T, S>::create_dir(char *pathname, int mode)
 {
 	char *p;
 	int r;
@@ -193,8 +1204,8 @@ void Tar<T>::create_dir(char *pathname, int mode)
 }
 #endif
 
-template <typename T>
-void *Tar<T>::emalloc(size_t size) {
+template <typename T, typename S>
+void *Tar<T, S>::emalloc(size_t size) {
 	void *p= malloc(size);
 #ifndef TAR_SILENT
 	if (!p && msglevel>=1) {
@@ -204,11 +1215,11 @@ void *Tar<T>::emalloc(size_t size) {
 	return p;
 }
 
-template <typename T>
-File* Tar<T>::create_file(char *pathname)
+template <typename T, typename S>
+typename Tar<T, S>::FileType* Tar<T, S>::create_file(char *pathname)
 {
-	File* f;
-	f = new File();
+	FileType* f;
+	f = new FileType();
 	*f = FSC->open(pathname, "w+");
 	#ifdef TAR_MKDIR
 	if (!f->isOpen()) {
@@ -225,25 +1236,20 @@ File* Tar<T>::create_file(char *pathname)
 	return (f);
 }
 
-template <typename T>
-int Tar<T>::verify_checksum(const char *p)
+template <typename T, typename S>
+void Tar<T, S>::extract()
 {
-	int n, u = 0;
-	for (n = 0; n < 512; ++n) {
-		if (n < 148 || n > 155)
-			/* Standard tar checksum adds unsigned bytes. */
-			u += ((unsigned char *)p)[n];
-		else
-			u += 0x20;
-
+	#ifdef TAR_POOL
+	if (!acquire_buff()) {
+		_state = TAR_POOL_EMPTY;
+		return;
+	}
+	if (blockpool == NULL && chunksize > 512 && chunkbuf == NULL) {
+	#else
+	if (chunksize > 512 && chunkbuf == NULL) {
+	#endif
+		chunkbuf = (char*)emalloc(chunksize);	// Without it blocks are written directly
 	}
-	return (u == parseoct(p + 148, 8));
-}
-
-template <typename T>
-void Tar<T>::extract()
-{
-	char* fullpath = NULL;
 	#ifndef TAR_SILENT
 	if (msglevel>=2) {
 		if (pending_filesize == 0) {
@@ -255,9 +1261,12 @@ void Tar<T>::extract()
 	#endif
 	for (;;) {
 		if (bytes_read > 0) {
-			bytes_read += source->readBytes(buff, 512 - bytes_read);
+			size_t n = source->readBytes(buff + bytes_read, 512 - bytes_read);
+			bytes_read += n;
+			archive_offset += n;
 		} else {
 			bytes_read = source->readBytes(buff, 512);
+			archive_offset += bytes_read;
 		}
 		if (bytes_read == 0 && pending_filesize == 0) {
 			#ifndef TAR_SILENT
@@ -265,6 +1274,11 @@ void Tar<T>::extract()
 				Serial.println("End of source file");
 			}
 			#endif
+			applyMeta();		// Archives without the end-of-archive marker end here
+			#ifdef TAR_CALLBACK
+			member_size = 0;
+			progress(true);
+			#endif
 			_state = TAR_SOURCE_EOF;
 			goto RETURN;
 		}
@@ -278,6 +1292,50 @@ void Tar<T>::extract()
 			_state = TAR_SHORT_READ;
 			goto RETURN;
 		}
+		#ifdef TAR_CHECKPOINT
+		if (ckcheck > 0) {
+			/* Re-reading what the resumed checkpoint covers: it has to be the same */
+			bool same;
+			ckcheck -= 512;
+			if (archive_offset - 512 == header_offset) {
+				same = tar_crc32(0, (const uint8_t*)buff, 512) == ckheader;
+				meta_isdir = false;
+				meta_mode = parseoct(buff + 100, 8) & 07777;
+				meta_mtime = parseoct(buff + 136, 12);
+				meta_record = keepmeta && f != NULL && f->isOpen();
+			} else {
+				digest = tar_crc32(digest, (const uint8_t*)buff, 512);
+				same = ckcheck > 0 || digest == ckdigest;
+			}
+			if (!same) {
+				#ifndef TAR_SILENT
+				if (msglevel>=1) {
+					Serial.println("* Archive differs from the checkpoint, extract it from the start");
+				}
+				#endif
+				if (f != NULL) {
+					if (f->isOpen()) f->close();
+					delete f;
+					f = NULL;
+				}
+				pending_filesize = 0;
+				member_size = 0;
+				ckcheck = 0;
+				bytes_read = 0;
+				remove_checkpoint();
+				_state = TAR_RESUME_MISMATCH;
+				goto RETURN;
+			}
+			if (pending_filesize > 0) {
+				bytes_read = 0;		// Already written
+				#ifdef TAR_CALLBACK
+				progress(false);
+				#endif
+				continue;
+			}
+			/* Header of a member restarted from scratch: process it */
+		}
+		#endif
 		if (pending_filesize == 0) {
 			if (is_end_of_archive(buff)) {
 				#ifndef TAR_SILENT
@@ -285,6 +1343,16 @@ void Tar<T>::extract()
 					Serial.println("End of source file");
 				}
 				#endif
+				#ifdef TAR_CHECKPOINT
+				if (ckpath != NULL) {
+					remove_checkpoint();	// Archive complete, nothing to resume
+				}
+				#endif
+				applyMeta();
+				#ifdef TAR_CALLBACK
+				member_size = 0;
+				progress(true);
+				#endif
 				_state = TAR_SOURCE_EOF;
 				goto RETURN;
 			}
@@ -312,6 +1380,19 @@ void Tar<T>::extract()
 				#endif
 			} else {
 				_state = TAR_IDLE;
+				member_size = 0;
+				meta_record = false;
+				meta_isdir = buff[156] == '5';
+				meta_mode = parseoct(buff + 100, 8) & 07777;
+				meta_mtime = parseoct(buff + 136, 12);
+				#ifdef TAR_CHECKPOINT
+				header_offset = archive_offset - 512;
+				digest = 0;
+				header_crc = tar_crc32(0, (const uint8_t*)buff, 512);
+				if (header_offset == 0) {
+					archive_id = header_crc;
+				}
+				#endif
 				//pending_filesize = parseoct(buff + 124, 12);
 				fullpath[0]= '\0';
 				if (pathprefix) strcpy (fullpath, pathprefix);
@@ -359,6 +1440,7 @@ void Tar<T>::extract()
 					}
 					#endif
 					create_dir(fullpath, parseoct(buff + 100, 8));
+					meta_record = keepmeta;
 					#else
 					#ifndef TAR_SILENT
 					if (msglevel>=2) {
@@ -384,19 +1466,42 @@ void Tar<T>::extract()
 					}
 					#endif
 					pending_filesize = parseoct(buff + 124, 12);
+					member_size = pending_filesize;
 					_state = TAR_FILE_EXTRACT;
 					#ifdef TAR_CALLBACK
-					if (cbProcess == NULL || cbProcess(buff))
+					if ((cbProcess == NULL || cbProcess(buff))
+					 && (cbProcessCtx == NULL || cbProcessCtx(ctxProcess, buff))
+					 && (dataSink == NULL || dataSink->file(buff)))
 					#endif
 					{
-						int ignored_fmode= parseoct(buff + 100, 8);
-						(void)ignored_fmode;
 						f = create_file(fullpath);
+						meta_record = keepmeta && f->isOpen();
+						chunk_fill = 0;
+						chunk_limit = chunksize;
+						file_written = 0;
+						if (f->isOpen() && !tar_reserve(f, pending_filesize, 0)) {
+							#ifndef TAR_SILENT
+							if (msglevel>=1) {
+								Serial.println(" - No space for file");
+							}
+							#endif
+							_state = TAR_WRITE_ERROR;
+							f->close();
+							delete f;
+							f = NULL;
+							tar_remove(FSC, fullpath, 0);	// Don't leave an empty member behind
+						}
 					}
 					break;
 				}
 			}
 			bytes_read = 0;
+			#ifdef TAR_CHECKPOINT
+			save_checkpoint();
+			#endif
+			#ifdef TAR_CALLBACK
+			progress(false);
+			#endif
 		}
 		while (pending_filesize > 0) {
 			#ifndef TAR_SILENT
@@ -404,8 +1509,10 @@ void Tar<T>::extract()
 				Serial.print(".");
 			}
 			#endif
-			if (bytes_read == 0)
+			if (bytes_read == 0) {
 				bytes_read = source->readBytes(buff, 512);
+				archive_offset += bytes_read;
+			}
 			if (bytes_read < 512) {
 				#ifndef TAR_SILENT
 				if (msglevel>=1) {
@@ -419,24 +1526,31 @@ void Tar<T>::extract()
 			if (pending_filesize < 512)
 				bytes_read = pending_filesize;
 			if (f != NULL && f->isOpen()) {
-				if (f->write((uint8_t*)buff, bytes_read) != bytes_read) {
-					#ifndef TAR_SILENT
-					if (msglevel>=1) {
-						Serial.println(" - Failed write");
-					}
-					#endif
-					_state = TAR_WRITE_ERROR;
-					f->close();
-					delete f;
-					f = NULL;
+				if (!write_out(buff, bytes_read)) {
+					fail_write();
 				}
 			}
+			#ifdef TAR_CHECKPOINT
+			if (ckpath != NULL) {		// Also of skipped members, resume() compares it with the archive
+				digest = tar_crc32(digest, (const uint8_t*)buff, bytes_read);
+			}
+			#endif
 			#ifdef TAR_CALLBACK
 			if (cbData != NULL)
 				cbData(buff, bytes_read);
+			if (cbDataCtx != NULL)
+				cbDataCtx(ctxData, buff, bytes_read);
+			if (dataSink != NULL)
+				dataSink->data(buff, bytes_read);
 			#endif
 			pending_filesize -= bytes_read;
 			bytes_read = 0;
+			#ifdef TAR_CHECKPOINT
+			save_checkpoint();
+			#endif
+			#ifdef TAR_CALLBACK
+			progress(false);
+			#endif
 		}
 		if (f != NULL) {
 			#ifndef TAR_SILENT
@@ -444,37 +1558,61 @@ void Tar<T>::extract()
 				Serial.println();
 			}
 			#endif
-			if (f->isOpen()) f->close();
-			delete f;
-			f = NULL;
+			if (f->isOpen() && !flush_out()) {
+				fail_write();
+			} else {
+				if (f->isOpen()) f->close();
+				delete f;
+				f = NULL;
+			}
 		}
-		_state = TAR_DONE;
-		if (fullpath) {
-			free(fullpath);
-			fullpath= NULL;
+		if (_state != TAR_WRITE_ERROR) {
+			_state = TAR_DONE;
 		}
 		#ifdef TAR_CALLBACK
 		if (cbEof != NULL)
 			cbEof();
+		if (cbEofCtx != NULL || dataSink != NULL) {
+			const char *name = member_name();
+			if (cbEofCtx != NULL)
+				cbEofCtx(ctxEof, name, member_size, _state);
+			if (dataSink != NULL)
+				dataSink->eof(name, member_size, _state);
+		}
 		#endif
+		if (meta_record && fullpath && _state != TAR_WRITE_ERROR) {
+			keep_meta();
+		}
+		if (fullpath) {
+			free(fullpath);
+			fullpath= NULL;
+		}
 		bytes_read = 0;
 	}
 RETURN:
-	if (f != NULL) {
+	if (_state == TAR_SHORT_READ && pending_filesize > 0) {
+		/* Keep the file open: the next extract() continues it */
+	} else if (f != NULL) {
 		#ifndef TAR_SILENT
 		if (msglevel>=2) {
 			Serial.println();
 		}
 		#endif
+		if (f->isOpen()) flush_out();
 		f->close();
 		delete f;
 		f = NULL;
 	}
-	if (fullpath) {
+	if (fullpath && pending_filesize == 0) {
 		free(fullpath);
 		fullpath = NULL;
 	}
 	if (source!=NULL && source->isOpen()) {
 		source->close();
 	}
+	#ifdef TAR_POOL
+	if (_state != TAR_SHORT_READ || (bytes_read == 0 && chunk_fill == 0)) {
+		release_buff();		// Nothing in the block is needed by the next extract()
+	}
+	#endif
 }
@@ -0,0 +1,272 @@
+/* ProfileFS.h */
+
+/* Instrumenting wrapper around any FS backend (e.g. stdmapper's FS): */
+/* counts calls, measures their latency and records histograms of */
+/* write sizes and write offset alignment. Use it as Tar<ProfileFS<FS>> */
+/* and call report() after extract(). */
+
+#ifndef PROFILEFS_H
+#define PROFILEFS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <utility>
+
+enum ProfileOp {
+    PrOp_Open, PrOp_Close, PrOp_Write, PrOp_Read, PrOp_Flush, PrOp_Seek,
+    PrOp_Truncate, PrOp_Reserve, PrOp_Mkdir, PrOp_Remove, PrOp_Chmod, PrOp_Utime,
+    PrOp_Count
+};
+
+static const char *ProfileOpNames[PrOp_Count]= {
+    "open", "close", "write", "read", "flush", "seek",
+    "truncate", "reserve", "mkdir", "remove", "chmod", "utime"
+};
+
+#define PROFILE_BUCKETS 18      /* power of two buckets: <1, <2, <4, ... >=64K */
+
+struct ProfileStats {
+    unsigned long calls[PrOp_Count];
+    unsigned long failed[PrOp_Count];
+    uint64_t nanos[PrOp_Count];
+    uint64_t maxnanos[PrOp_Count];
+    uint64_t bytes_written;
+    unsigned long write_size[PROFILE_BUCKETS];  /* by size */
+    unsigned long write_align[PROFILE_BUCKETS]; /* by largest power of two dividing the offset, */
+                                                /* bucket 0: offset 0 */
+    unsigned long inner_writes;                 /* writes followed by another one to the same file */
+    size_t inner_min_size;                      /* smallest of them */
+    size_t inner_min_align;                     /* smallest power of two dividing their offsets, */
+                                                /* 0 if all were at offset 0 */
+
+    ProfileStats() {
+        memset(this, 0, sizeof(*this));
+    }
+
+    static uint64_t Now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec*1000000000u + ts.tv_nsec;
+    }
+
+    static int Bucket(size_t v) {
+        int b= 0;
+        while (v>0 && b<PROFILE_BUCKETS-1) {
+            v >>= 1;
+            ++b;
+        }
+        return b;
+    }
+
+    void Record(ProfileOp op, uint64_t start, bool ok) {
+        uint64_t d= Now() - start;
+        ++calls[op];
+        if (!ok) ++failed[op];
+        nanos[op] += d;
+        if (d>maxnanos[op]) maxnanos[op]= d;
+    }
+
+    void RecordWrite(size_t offs, size_t len) {
+        bytes_written += len;
+        ++write_size[Bucket(len)];
+        /* offset 0 (first write of a file) has its own bucket, others are >=1 */
+        ++write_align[offs? Bucket(offs & -offs): 0];
+    }
+
+    void RecordInner(size_t offs, size_t len) {
+        size_t align= offs & -offs;
+        if (inner_writes==0 || len<inner_min_size) inner_min_size= len;
+        if (align && (inner_min_align==0 || align<inner_min_align)) inner_min_align= align;
+        ++inner_writes;
+    }
+
+    static void BucketName(char *buf, int b) {
+        if (b==0)                    strcpy(buf, "0");
+        else if (b==PROFILE_BUCKETS-1) sprintf(buf, ">=%lu", 1UL<<(b-1));
+        else                         sprintf(buf, "%lu-%lu", 1UL<<(b-1), (1UL<<b)-1);
+    }
+};
+
+template <typename F>
+class ProfileFile {
+private:
+    F file;
+    ProfileStats *stats;
+    size_t offs;
+    size_t lastoffs, lastlen;   /* previous write, lastlen 0 if none */
+
+public:
+    ProfileFile() {
+        stats= NULL;
+        offs= lastoffs= lastlen= 0;
+    }
+
+    template <typename B>
+    ProfileFile(ProfileStats *pstats, B *backend, const char *name, const char *mode) {
+        stats= pstats;
+        offs= lastoffs= lastlen= 0;
+        uint64_t t= ProfileStats::Now();
+        file= backend->open(name, mode);
+        stats->Record(PrOp_Open, t, file.isOpen());
+    }
+
+    size_t write(uint8_t *buff, size_t len) {
+        uint64_t t= ProfileStats::Now();
+        size_t wrlen= file.write(buff, len);
+        stats->Record(PrOp_Write, t, wrlen==len);
+        stats->RecordWrite(offs, len);
+        if (lastlen) stats->RecordInner(lastoffs, lastlen);
+        lastoffs= offs;
+        lastlen= len;
+        offs += wrlen;
+        return wrlen;
+    }
+
+    size_t readBytes(char *buff, size_t len) {
+        uint64_t t= ProfileStats::Now();
+        size_t rdlen= file.readBytes(buff, len);
+        stats->Record(PrOp_Read, t, rdlen==len);
+        offs += rdlen;
+        return rdlen;
+    }
+
+    void flush() {
+        uint64_t t= ProfileStats::Now();
+        file.flush();
+        stats->Record(PrOp_Flush, t, true);
+    }
+
+    bool seek(size_t pos) {
+        uint64_t t= ProfileStats::Now();
+        bool ok= file.seek(pos);
+        stats->Record(PrOp_Seek, t, ok);
+        if (ok) offs= pos;
+        return ok;
+    }
+
+    bool truncate(size_t size) {
+        uint64_t t= ProfileStats::Now();
+        bool ok= file.truncate(size);
+        stats->Record(PrOp_Truncate, t, ok);
+        return ok;
+    }
+
+/* only if the backend's file has it, see tar_reserve() */
+    template <typename X= F>
+    auto reserve(size_t size) -> decltype(std::declval<X&>().reserve(size)) {
+        uint64_t t= ProfileStats::Now();
+        bool ok= file.reserve(size);
+        stats->Record(PrOp_Reserve, t, ok);
+        return ok;
+    }
+
+    int close() {
+        if (!stats) return 0;
+        uint64_t t= ProfileStats::Now();
+        int rc= file.close();
+        stats->Record(PrOp_Close, t, true);
+        return rc;
+    }
+
+    bool isOpen() {
+        return file.isOpen();
+    }
+
+    operator bool() {
+        return isOpen();
+    }
+};
+
+template <typename B>
+class ProfileFS {
+private:
+    B *backend;
+    ProfileStats stats;
+
+public:
+    typedef decltype(std::declval<B&>().open("", "")) BackendFile;
+
+    ProfileFS(B *pbackend) {
+        backend= pbackend;
+    }
+
+    ProfileFile<BackendFile> open(const char *name, const char *mode) {
+        return ProfileFile<BackendFile>(&stats, backend, name, mode);
+    }
+
+/* The following exist only if the backend has them */
+    template <typename X= B>
+    auto mkdir(const char *pathname, int mode) -> decltype(std::declval<X&>().mkdir(pathname, mode)) {
+        uint64_t t= ProfileStats::Now();
+        int rc= backend->mkdir(pathname, mode);
+        stats.Record(PrOp_Mkdir, t, rc==0);
+        return rc;
+    }
+
+    template <typename X= B>
+    auto remove(const char *name) -> decltype(std::declval<X&>().remove(name)) {
+        uint64_t t= ProfileStats::Now();
+        bool ok= backend->remove(name);
+        stats.Record(PrOp_Remove, t, ok);
+        return ok;
+    }
+
+    template <typename X= B>
+    auto chmod(const char *pathname, int mode) -> decltype(std::declval<X&>().chmod(pathname, mode)) {
+        uint64_t t= ProfileStats::Now();
+        int rc= backend->chmod(pathname, mode);
+        stats.Record(PrOp_Chmod, t, rc==0);
+        return rc;
+    }
+
+    template <typename X= B>
+    auto utime(const char *pathname, uint32_t mtime) -> decltype(std::declval<X&>().utime(pathname, mtime)) {
+        uint64_t t= ProfileStats::Now();
+        int rc= backend->utime(pathname, mtime);
+        stats.Record(PrOp_Utime, t, rc==0);
+        return rc;
+    }
+
+    const ProfileStats &getStats() const {
+        return stats;
+    }
+
+    void reset() {
+        stats= ProfileStats();
+    }
+
+    void report(FILE *out) {
+        char name[32];
+        int i;
+
+        fprintf(out, "%-10s %8s %8s %12s %12s %12s\n",
+            "call", "count", "failed", "total us", "avg us", "max us");
+        for (i= 0; i<PrOp_Count; ++i) {
+            if (stats.calls[i]==0) continue;
+            fprintf(out, "%-10s %8lu %8lu %12.1f %12.2f %12.1f\n",
+                ProfileOpNames[i], stats.calls[i], stats.failed[i],
+                stats.nanos[i]/1000.0, stats.nanos[i]/1000.0/stats.calls[i],
+                stats.maxnanos[i]/1000.0);
+        }
+        fprintf(out, "bytes written: %llu\n", (unsigned long long)stats.bytes_written);
+        if (stats.inner_writes)
+            fprintf(out, "non-final writes: %lu, smallest %lu, offsets aligned to %lu\n",
+                stats.inner_writes, (unsigned long)stats.inner_min_size,
+                (unsigned long)stats.inner_min_align);
+
+        fprintf(out, "%-14s %8s    %-14s %8s\n", "write size", "count", "offset align", "count");
+        for (i= 0; i<PROFILE_BUCKETS; ++i) {
+            if (stats.write_size[i]==0 && stats.write_align[i]==0) continue;
+            ProfileStats::BucketName(name, i);
+            fprintf(out, "%-14s %8lu    ", name, stats.write_size[i]);
+            if (i==0)                      strcpy(name, "offset 0");
+            else if (i==PROFILE_BUCKETS-1) strcpy(name, ">=64K");
+            else                           sprintf(name, "%lu", 1UL<<(i-1));
+            fprintf(out, "%-14s %8lu\n", name, stats.write_align[i]);
+        }
+    }
+};
+
+#endif
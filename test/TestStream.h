@@ -0,0 +1,63 @@
+/* TestStream.h */
+
+/* Source wrapper for tests of interrupted extractions. It reads at */
+/* most 'maxread' bytes per readBytes() (a short read, like a network */
+/* client on timeout), at most the amount given to Allow() until it is */
+/* called again (one extract() call's worth), and can return nothing */
+/* once at a given archive offset. close() is a no-op, the test closes */
+/* the file itself. */
+
+#ifndef TESTSTREAM_H
+#define TESTSTREAM_H
+
+#include <stdint.h>
+
+class TestStream : public Stream {
+private:
+    File *file;
+    size_t maxread;
+    size_t budget;
+    size_t offs;
+    size_t stall;
+
+public:
+    TestStream(File *pfile, size_t pmaxread= SIZE_MAX) : Stream() {
+        file= pfile;
+        maxread= pmaxread;
+        budget= SIZE_MAX;
+        offs= 0;
+        stall= SIZE_MAX;
+    }
+
+    void Allow(size_t n) {
+        budget= n;
+    }
+
+    void StallAt(size_t poffs) {
+        stall= poffs;
+    }
+
+    size_t readBytes(char *buff, size_t len) {
+        if (len>maxread) len= maxread;
+        if (len>budget) len= budget;
+        if (offs==stall) {
+            stall= SIZE_MAX;
+            return 0;
+        }
+        if (offs<stall && offs+len>stall) len= stall-offs;
+        size_t rdlen= file->readBytes(buff, len);
+        offs += rdlen;
+        if (budget!=SIZE_MAX) budget -= rdlen;
+        return rdlen;
+    }
+
+    bool isOpen() {
+        return file->isOpen();
+    }
+
+    int close() {
+        return 0;
+    }
+};
+
+#endif
@@ -0,0 +1,43 @@
+/* chunk1.cc */
+
+/* Extracts the archive a few hundred bytes per extract() call and */
+/* changes the write chunk size between the calls, while members are */
+/* open; the result must match a direct extraction */
+
+#include <stdio.h>
+
+#include "stdmapper.h"
+#include "untar.h"
+#include "TestStream.h"
+
+#define SLICE   700
+
+static const size_t Sizes[]= { 4096, 1024, 8192, 512, 2048, 700 };
+
+int main(int argc, char **argv) {
+    if (argc!=2) {
+        fprintf(stderr, "usage: %s <filename>\n", argv[0]);
+        return 1;
+    }
+    fprintf(stderr, "\nchunk1: extracting '%s' into 'chunk1_out/'\n", argv[1]);
+
+    File f= SPIFFS.open(argv[1], "r");
+    if (!f) {
+        return 1;
+    }
+    TestStream src(&f);
+    Tar<FS> tar(&SPIFFS, 1);
+    unsigned long calls= 0;
+
+    tar.dest("chunk1_out/");
+    tar.open(&src);
+    do {
+        tar.chunk(Sizes[calls % (sizeof(Sizes)/sizeof(Sizes[0]))]);
+        src.Allow(SLICE);
+        tar.extract();
+        ++calls;
+    } while (tar.state()==TAR_SHORT_READ);
+    f.close();
+    fprintf(stderr, "chunk1: %lu extract() calls, final state %d\n", calls, (int)tar.state());
+    return tar.state()==TAR_SOURCE_EOF? 0: 1;
+}
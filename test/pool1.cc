@@ -0,0 +1,156 @@
+/* pool1.cc */
+
+/* Extracts the archive with three Tar objects sharing a pool of two */
+/* blocks; the source hands out a few hundred bytes per extract() call, */
+/* so the objects take turns and must wait when the pool is empty. */
+/* Then a resume() finding the pool empty has to keep the checkpoint. */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define TAR_POOL
+
+#include "stdmapper.h"
+#include "untar.h"
+#include "TestStream.h"
+
+#define NTARS   3
+#define NBLOCKS 2
+#define CHUNK   4096
+#define SLICE   700
+#define CKFILE  "pool1.ck"
+
+static char poolmem[NBLOCKS*(512 + CHUNK)];
+
+static void Extract(const char *fname, const char *prefix);
+static bool ResumeWhenEmpty(const char *fname);
+
+int main(int argc, char **argv) {
+    if (argc!=2) {
+        fprintf(stderr, "usage: %s <filename>\n", argv[0]);
+        return 1;
+    }
+    Extract(argv[1], "pool1_ref/");
+
+    /* Blocks smaller than a tar block must never be handed out */
+    TarBlockPool small(poolmem, 256, NBLOCKS);
+    if (small.acquire()!=NULL) {
+        fprintf(stderr, "pool1: pool of 256 byte blocks handed out a block\n");
+        return 1;
+    }
+
+    TarBlockPool pool(poolmem, 512 + CHUNK, NBLOCKS);
+    Tar<FS> *tar[NTARS];
+    File file[NTARS];
+    TestStream *src[NTARS];
+    char prefix[32];
+    bool done[NTARS];
+    int ndone= 0, i;
+    unsigned long calls= 0, waits= 0;
+
+    for (i= 0; i<NTARS; ++i) {
+        file[i]= SPIFFS.open(argv[1], "r");
+        if (!file[i]) return 1;
+        src[i]= new TestStream(&file[i]);
+        tar[i]= new Tar<FS>(&SPIFFS, 1);
+        tar[i]->pool(&pool);
+        tar[i]->chunk(CHUNK);
+        sprintf(prefix, "pool1_out%d/", i);
+        tar[i]->dest(prefix);
+        tar[i]->open(src[i]);
+        done[i]= false;
+    }
+    while (ndone<NTARS) {
+        for (i= 0; i<NTARS; ++i) {
+            if (done[i]) continue;
+            src[i]->Allow(SLICE);
+            tar[i]->extract();
+            ++calls;
+            if (pool.inUse()>NBLOCKS) {
+                fprintf(stderr, "pool1: %u blocks in use\n", pool.inUse());
+                return 1;
+            }
+            switch (tar[i]->state()) {
+            case TAR_POOL_EMPTY:
+                ++waits;
+                break;
+            case TAR_SHORT_READ:
+                break;
+            default:
+                done[i]= true;
+                ++ndone;
+                break;
+            }
+        }
+    }
+    for (i= 0; i<NTARS; ++i) {
+        delete tar[i];
+        delete src[i];
+        file[i].close();
+    }
+    fprintf(stderr, "pool1: %lu extract() calls, %lu waited for a block, %u blocks in use at the end\n",
+        calls, waits, pool.inUse());
+    if (waits==0 || pool.inUse()!=0) return 1;
+    return ResumeWhenEmpty(argv[1])? 0: 1;
+}
+
+static bool ResumeWhenEmpty(const char *fname) {
+    TarBlockPool pool(poolmem, 512 + CHUNK, 1);
+
+    fprintf(stderr, "\npool1: resuming '%s' into 'pool1_res/' with an empty pool\n", fname);
+    remove(CKFILE);
+    remove(CKFILE "~");
+    File f= SPIFFS.open(fname, "r");
+    if (!f) return false;
+    {
+        TestStream src(&f);
+        Tar<FS> tar(&SPIFFS, 1);
+        tar.pool(&pool);
+        tar.dest("pool1_res/");
+        tar.checkpoint(CKFILE, 1024);
+        tar.open(&src);
+        src.Allow(9000);
+        tar.extract();          /* interrupted, the checkpoint stays */
+    }
+
+    Tar<FS> tar(&SPIFFS, 1);
+    tar.pool(&pool);
+    tar.dest("pool1_res/");
+    tar.checkpoint(CKFILE, 1024);
+    f.seek(0);
+    tar.open(&f);
+    char *busy= pool.acquire();
+    size_t offs= tar.resume();
+    if (tar.state()!=TAR_POOL_EMPTY || offs!=0 || access(CKFILE, F_OK)!=0) {
+        fprintf(stderr, "pool1: resume() with an empty pool: state %d offset %ld\n",
+            (int)tar.state(), (long)offs);
+        return false;
+    }
+    pool.release(busy);
+    offs= tar.resume();
+    if (tar.state()==TAR_POOL_EMPTY || offs==0) {
+        fprintf(stderr, "pool1: resume() after the retry: state %d offset %ld\n",
+            (int)tar.state(), (long)offs);
+        return false;
+    }
+    fprintf(stderr, "pool1: resuming at offset %ld\n", (long)offs);
+    f.seek(offs);
+    tar.extract();
+    if (f) f.close();
+    return tar.state()==TAR_SOURCE_EOF && pool.inUse()==0;
+}
+
+static void Extract(const char *fname, const char *prefix) {
+    fprintf(stderr, "\npool1: extracting '%s' into '%s'\n", fname, prefix);
+
+    Tar<FS> tar(&SPIFFS, 1);
+
+    File f= SPIFFS.open(fname, "r");
+    if (!f) {
+        return;
+    }
+    tar.open(&f);
+    tar.dest(prefix);
+    tar.extract();
+    if (f) f.close();
+}
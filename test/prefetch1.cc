@@ -0,0 +1,74 @@
+/* prefetch1.cc */
+
+/* Extracts the archive through a TarPrefetch read-ahead stage and */
+/* compares the result with a direct extraction. The source returns */
+/* short reads, which must not end the prefetched stream; it also */
+/* returns nothing once, after which extract() has to continue. */
+/* Built as prefetch1 (reader thread) and prefetch1_nothread. */
+
+#include <stdio.h>
+
+#ifndef PREFETCH1_NOTHREAD
+#define TAR_PREFETCH_THREAD
+#endif
+
+#include "stdmapper.h"
+#include "untar.h"
+#include "TarPrefetch.h"
+#include "TestStream.h"
+
+/* Short reads, like a network client on timeout */
+#define CHOPPY 300
+
+/* Archive offsets where the source returns nothing once */
+static const size_t Stalls[]= { 1000, 5000, 12000 };
+static int Continued;   /* extractions that went on after a short read */
+
+static bool Extract(const char *fname, const char *prefix, bool prefetch, size_t stall);
+
+int main(int argc, char **argv) {
+    if (argc!=2) {
+        fprintf(stderr, "usage: %s <filename>\n", argv[0]);
+        return 1;
+    }
+    bool ok= Extract(argv[1], "prefetch1_ref/", false, 0)
+          && Extract(argv[1], "prefetch1_out/", true, 0);
+    for (size_t i= 0; ok && i<sizeof(Stalls)/sizeof(Stalls[0]); ++i) {
+        char prefix[64];
+        snprintf(prefix, sizeof(prefix), "prefetch1_stall%ld/", (long)Stalls[i]);
+        ok= Extract(argv[1], prefix, true, Stalls[i]);
+    }
+    /* A stall may also be absorbed by a read that got data before it */
+    fprintf(stderr, "prefetch1: %d extractions continued after a short read\n", Continued);
+    return ok && Continued>0? 0: 1;
+}
+
+static bool Extract(const char *fname, const char *prefix, bool prefetch, size_t stall) {
+    fprintf(stderr, "\nprefetch1: extracting '%s' into '%s'%s\n",
+        fname, prefix, prefetch? " (prefetch)": "");
+
+    Tar<FS> tar(&SPIFFS, 1);
+
+    File f= SPIFFS.open(fname, "r");
+    if (!f) {
+        return false;
+    }
+    TestStream cs(&f, CHOPPY);
+    if (stall) cs.StallAt(stall);
+    TarPrefetch pf(&cs, 8);
+    tar.open(prefetch? (Stream*)&pf: (Stream*)&f);
+    tar.dest(prefix);
+    int calls= 0;
+    do {
+        tar.extract();
+        ++calls;
+    } while (tar.state()==TAR_SHORT_READ && calls<10);
+    pf.end();
+    if (f) f.close();
+    if (tar.state()!=TAR_SOURCE_EOF || calls>(stall? 2: 1)) {
+        fprintf(stderr, "prefetch1: state %d after %d extract() calls\n", (int)tar.state(), calls);
+        return false;
+    }
+    if (calls>1) ++Continued;
+    return true;
+}
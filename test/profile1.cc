@@ -0,0 +1,68 @@
+/* profile1.cc */
+
+/* Extracts archives through ProfileFS and prints the I/O pattern. */
+/* Given the number of files and directories in the archive, it also */
+/* checks the calls: one open per file, one mkdir per directory, one */
+/* write at offset 0 per file (the archives have no empty files), and */
+/* with a chunk size, no write but the last of a file shorter than a */
+/* chunk or off a chunk boundary. Run it with an existing, empty dest. */
+
+#include <stdio.h>
+
+#include "stdmapper.h"
+#include "untar.h"
+#include "ProfileFS.h"
+
+int main(int argc, char **argv) {
+    if (argc<2) {
+        fprintf(stderr, "usage: %s <filename> [<chunk> [<files> <dirs>]]\n", argv[0]);
+        return 1;
+    }
+    size_t chunk= argc>2? (size_t)atol(argv[2]): 0;
+    bool check= argc>4;
+    unsigned long files= check? atol(argv[3]): 0;
+    unsigned long dirs= check? atol(argv[4]): 0;
+
+    ProfileFS<FS> pfs(&SPIFFS);
+    Tar<ProfileFS<FS> > tar(&pfs, 1);
+
+    File f= SPIFFS.open(argv[1], "r");
+    if (!f) {
+        return 1;
+    }
+    tar.open(&f);
+    tar.dest("profile1_out/");
+    if (chunk) tar.chunk(chunk);
+    tar.extract();
+    if (f) f.close();
+
+    printf("profile1: '%s' chunk %ld\n", argv[1], (long)chunk);
+    pfs.report(stdout);
+    if (!check) return 0;
+
+    const ProfileStats &st= pfs.getStats();
+    int errors= 0;
+    if (st.calls[PrOp_Open]!=files || st.failed[PrOp_Open]!=0) {
+        fprintf(stderr, "profile1: %lu opens (%lu failed), expected %lu\n",
+            st.calls[PrOp_Open], st.failed[PrOp_Open], files);
+        ++errors;
+    }
+    if (st.calls[PrOp_Mkdir]!=dirs || st.failed[PrOp_Mkdir]!=0) {
+        fprintf(stderr, "profile1: %lu mkdirs (%lu failed), expected %lu\n",
+            st.calls[PrOp_Mkdir], st.failed[PrOp_Mkdir], dirs);
+        ++errors;
+    }
+    if (st.write_align[0]!=files) {
+        fprintf(stderr, "profile1: %lu writes at offset 0, expected %lu\n",
+            st.write_align[0], files);
+        ++errors;
+    }
+    if (chunk && (st.inner_writes==0 || st.inner_min_size<chunk
+     || (st.inner_min_align!=0 && st.inner_min_align<chunk))) {
+        fprintf(stderr, "profile1: %lu non-final writes, smallest %lu, aligned to %lu, chunk %lu\n",
+            st.inner_writes, (unsigned long)st.inner_min_size,
+            (unsigned long)st.inner_min_align, (unsigned long)chunk);
+        ++errors;
+    }
+    return errors? 1: 0;
+}
@@ -0,0 +1,108 @@
+/* ramfs1.cc */
+
+/* Extracts the archive into a TarRamFS arena and compares every */
+/* member with the same archive extracted to disk. Then extracts it */
+/* into an arena too small for its largest member, which must not */
+/* show up as an empty member, and checks a failed overwrite keeps */
+/* the old member. */
+
+#include <stdio.h>
+
+#include "stdmapper.h"
+#include "untar.h"
+#include "TarRamFS.h"
+
+#define PREFIX "ramfs1_ref/"
+
+static uint8_t arena[64*1024];
+static uint8_t small[6000];
+
+static int TooSmall(const char *fname);
+
+int main(int argc, char **argv) {
+    if (argc!=2) {
+        fprintf(stderr, "usage: %s <filename>\n", argv[0]);
+        return 1;
+    }
+
+    Tar<FS> tar(&SPIFFS, 1);
+    File f= SPIFFS.open(argv[1], "r");
+    if (!f) return 1;
+    tar.open(&f);
+    tar.dest(PREFIX);
+    tar.extract();
+
+    TarRamFS ramfs(arena, sizeof(arena));
+    Tar<TarRamFS> ramtar(&ramfs, 1);
+    f= SPIFFS.open(argv[1], "r");
+    if (!f) return 1;
+    ramtar.open(&f);
+    ramtar.extract();
+
+    int errors= 0;
+    for (size_t i= 0; i<ramfs.count(); ++i) {
+        const char *name= ramfs.name(i);
+        if (!name) continue;
+
+        char path[256];
+        snprintf(path, sizeof(path), "%s%s", PREFIX, name);
+        FILE *ref= fopen(path, "rb");
+        TarRamFile rf= ramfs.open(name, "r");
+        size_t same= 0;
+        int c;
+        while (ref && (c= getc(ref))!=EOF && c==rf.read()) {
+            ++same;
+        }
+        bool ok= ref && c==EOF && rf.available()==0;
+        fprintf(stderr, "ramfs1: %-60s %6ld bytes %s\n",
+            name, (long)rf.size(), ok? "OK": "*** DIFFERS");
+        if (!ok) ++errors;
+        if (ref) fclose(ref);
+        rf.close();
+    }
+    fprintf(stderr, "ramfs1: %ld of %ld arena bytes used\n",
+        (long)ramfs.used(), (long)sizeof(arena));
+    errors += TooSmall(argv[1]);
+    return errors? 1: 0;
+}
+
+static int TooSmall(const char *fname) {
+    TarRamFS ramfs(small, sizeof(small));
+    Tar<TarRamFS> ramtar(&ramfs, 1);
+    int errors= 0;
+
+    File f= SPIFFS.open(fname, "r");
+    if (!f) return 1;
+    ramtar.open(&f);
+    ramtar.extract();
+    for (size_t i= 0; i<ramfs.count(); ++i) {
+        const char *name= ramfs.name(i);
+        size_t size;
+        if (name && ramfs.data(name, &size) && size==0) {
+            fprintf(stderr, "ramfs1: '%s' did not fit but is served as 0 bytes\n", name);
+            ++errors;
+        }
+    }
+
+    /* Overwriting a member without room for it keeps the old copy */
+    const char *name= NULL;
+    for (size_t i= 0; i<ramfs.count() && !name; ++i) name= ramfs.name(i);
+    size_t before= 0, after= 0;
+    if (!name || !ramfs.data(name, &before)) return errors + 1;
+    while (ramfs.available()>0) {       /* fill the arena */
+        char filler[16];
+        snprintf(filler, sizeof(filler), "filler%ld", (long)ramfs.count());
+        TarRamFile rf= ramfs.open(filler, "w");
+        if (!rf) break;
+        rf.close();
+    }
+    TarRamFile rf= ramfs.open(name, "w");
+    if (rf || !ramfs.data(name, &after) || after!=before) {
+        fprintf(stderr, "ramfs1: failed overwrite of '%s' lost it (%ld -> %ld bytes)\n",
+            name, (long)before, (long)after);
+        ++errors;
+    }
+    fprintf(stderr, "ramfs1: small arena, %ld of %ld bytes used, %d errors\n",
+        (long)ramfs.used(), (long)sizeof(small), errors);
+    return errors;
+}
@@ -0,0 +1,85 @@
+/* resume1.cc */
+
+/* Interrupts an extraction after <cut> bytes of the archive, */
+/* then resumes it from the checkpoint with a new Tar object; */
+/* if <other> is given, resumes with that archive instead, whose */
+/* extraction must not be spliced with the first one's */
+
+#include <stdio.h>
+
+#include "stdmapper.h"
+#include "untar.h"
+
+#define CKFILE  "resume1.ck"
+#define PARTTAR "resume1.part.tar"
+
+static void CopyPart(const char *fname, size_t cut);
+static void Extract(const char *fname, const char *prefix, bool checkpoint, bool resume);
+
+int main(int argc, char **argv) {
+    if (argc!=3 && argc!=4) {
+        fprintf(stderr, "usage: %s <filename> <cut> [<other>]\n", argv[0]);
+        return 1;
+    }
+    const char *resumed= argc==4? argv[3]: argv[1];
+
+    remove(CKFILE);
+    remove(CKFILE "~");
+    remove(CKFILE "+");
+    Extract(resumed, "resume1_ref/", false, false);
+    CopyPart(argv[1], (size_t)atol(argv[2]));
+    Extract(PARTTAR, "resume1_out/", true, false);
+    Extract(resumed, "resume1_out/", true, true);
+    remove(PARTTAR);
+    return 0;
+}
+
+static void CopyPart(const char *fname, size_t cut) {
+    FILE *in= fopen(fname, "rb");
+    FILE *out= fopen(PARTTAR, "wb");
+    int c;
+
+    if (!in || !out) {
+        fprintf(stderr, "resume1: cannot copy '%s'\n", fname);
+        exit(1);
+    }
+    while (cut-- > 0 && (c= getc(in))!=EOF) {
+        putc(c, out);
+    }
+    fclose(in);
+    fclose(out);
+}
+
+static void Extract(const char *fname, const char *prefix, bool checkpoint, bool resume) {
+    fprintf(stderr, "\nresume1: extracting '%s' into '%s'%s\n",
+        fname, prefix, resume? " (resume)": "");
+
+    Tar<FS> tar(&SPIFFS, 2);
+
+    File f= SPIFFS.open(fname, "r");
+    if (!f) {
+        return;
+    }
+    tar.open(&f);
+    tar.dest(prefix);
+    if (checkpoint) {
+        tar.checkpoint(CKFILE, 1024);
+        tar.chunk(2048);    /* checkpoints have to flush the chunk buffer */
+    }
+    if (resume) {
+        size_t offs= tar.resume();
+        fprintf(stderr, "resume1: resuming at offset %ld\n", (long)offs);
+        f.seek(offs);
+    }
+    tar.extract();
+    if (tar.state()==TAR_RESUME_MISMATCH) {
+        fprintf(stderr, "resume1: archive differs from the checkpoint, extracting it again\n");
+        f= SPIFFS.open(fname, "r");
+        if (!f) {
+            return;
+        }
+        tar.open(&f);
+        tar.extract();
+    }
+    if (f) f.close();
+}
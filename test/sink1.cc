@@ -0,0 +1,127 @@
+/* sink1.cc */
+
+/* Extracts the archive through a template sink, Tar<FS, CountSink>: */
+/* every other file is left to the sink, the others are created. */
+/* The names, sizes, data bytes and states the sink sees are compared */
+/* with the headers read directly from the archive. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "stdmapper.h"
+#include "untar.h"
+
+#define MAXMEMBERS 64
+
+struct Member {
+    char name[101];
+    size_t size;
+    bool sunk;          /* file() returned 'false' */
+};
+
+static Member Expected[MAXMEMBERS];
+static int NExpected;
+
+struct CountSink {
+    int files;          /* file() calls */
+    int members;        /* eof() calls */
+    size_t bytes;       /* data() bytes of the current member */
+    int errors;
+
+    CountSink() {
+        files= members= errors= 0;
+        bytes= 0;
+    }
+
+    bool file(char *header) {
+        (void)header;
+        bytes= 0;
+        bool create= (files++ % 2)==0;  /* 'false': the sink takes the data */
+        if (!create && members<NExpected) Expected[members].sunk= true;
+        return create;
+    }
+
+    void data(char *buff, size_t size) {
+        (void)buff;
+        bytes += size;
+    }
+
+    void eof(const char *name, size_t size, tar_state state) {
+        if (members>=NExpected) {
+            fprintf(stderr, "sink1: unexpected member '%s'\n", name);
+            ++errors;
+            return;
+        }
+        const Member *m= &Expected[members++];
+        if (strcmp(name, m->name)!=0 || size!=m->size || bytes!=m->size || state!=TAR_DONE) {
+            fprintf(stderr, "sink1: '%s' size %ld data %ld state %d, expected '%s' size %ld\n",
+                name, (long)size, (long)bytes, (int)state, m->name, (long)m->size);
+            ++errors;
+        }
+        bytes= 0;
+    }
+};
+
+static bool ReadHeaders(const char *fname);
+
+int main(int argc, char **argv) {
+    if (argc!=2) {
+        fprintf(stderr, "usage: %s <filename>\n", argv[0]);
+        return 1;
+    }
+    if (!ReadHeaders(argv[1])) {
+        fprintf(stderr, "sink1: cannot read '%s'\n", argv[1]);
+        return 1;
+    }
+
+    CountSink sink;
+    Tar<FS, CountSink> tar(&SPIFFS, 1);
+    File f= SPIFFS.open(argv[1], "r");
+    if (!f) return 1;
+    tar.open(&f);
+    tar.dest("sink1_out/");
+    tar.sink(&sink);
+    tar.extract();
+    if (f) f.close();
+
+    for (int i= 0; i<NExpected; ++i) {
+        char path[128];
+        struct stat st;
+
+        snprintf(path, sizeof(path), "sink1_out/%s", Expected[i].name);
+        if (Expected[i].sunk && stat(path, &st)==0) {
+            fprintf(stderr, "sink1: '%s' was created, the sink took it\n", path);
+            ++sink.errors;
+        }
+    }
+    if (sink.members!=NExpected) {
+        fprintf(stderr, "sink1: %d members seen, %d expected\n", sink.members, NExpected);
+        ++sink.errors;
+    }
+    fprintf(stderr, "sink1: %d members, %d files, %d errors\n", sink.members, sink.files, sink.errors);
+    return sink.errors? 1: 0;
+}
+
+/* Member names and sizes straight from the headers; */
+/* only regular files have data */
+static bool ReadHeaders(const char *fname) {
+    FILE *in= fopen(fname, "rb");
+    char hdr[512];
+
+    if (!in) return false;
+    NExpected= 0;
+    while (fread(hdr, 1, 512, in)==512 && hdr[0]!='\0' && NExpected<MAXMEMBERS) {
+        Member *m= &Expected[NExpected++];
+        size_t size= strtoul(hdr + 124, NULL, 8);
+
+        memcpy(m->name, hdr, 100);
+        m->name[100]= '\0';
+        m->size= (hdr[156]>='1' && hdr[156]<='6')? 0: size;
+        m->sunk= false;
+        fseek(in, (size + 511) & ~(size_t)511, SEEK_CUR);
+    }
+    fclose(in);
+    return NExpected>0;
+}
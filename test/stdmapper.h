@@ -10,9 +10,12 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
+#include <utime.h>
 
 #define TAR_MKDIR
+#define TAR_CHECKPOINT
 
 enum FileState {FiSt_NotOpened, FiSt_OpenFailed, FiSt_PreOpened, FiSt_Opened};
 
@@ -42,7 +45,7 @@ public:
         offs= 0;
     }
 
-    ~Stream() {
+    virtual ~Stream() {
         if (fstate==FiSt_Opened) {
             fprintf(debugfile, "Stream.destructor *** file '%s' has never been closed\n",
                     FnameNVL(fname));
@@ -83,7 +86,8 @@ public:
         (void)n;
     }
 
-    size_t readBytes(char *buff, size_t len) {
+/* virtual like on the ESP cores, so Stream adapters (e.g. TarPrefetch) can be used as source */
+    virtual size_t readBytes(char *buff, size_t len) {
         size_t rdlen= fread(buff, 1, len, file);
         fprintf(debugfile, "readBytes(%d) read %d bytes from file '%s' offset %ld\n",
             (int)len, (int)rdlen, FnameNVL(fname), (long)offs);
@@ -104,7 +108,30 @@ public:
         return wrlen;
     }
 
-    int close() {
+    void flush() {
+        if (file) fflush(file);
+    }
+
+    bool seek(size_t pos) {
+        if (fstate!=FiSt_Opened || fseek(file, (long)pos, SEEK_SET)!=0) {
+            fprintf(debugfile, "*** Seek in file '%s' to offset %ld failed\n",
+                FnameNVL(fname), (long)pos);
+            return false;
+        }
+        offs= pos;
+        return true;
+    }
+
+    bool truncate(size_t size) {
+        if (fstate!=FiSt_Opened) return false;
+        fflush(file);
+        int rc= ftruncate(fileno(file), (off_t)size);
+        fprintf(debugfile, "truncate(%ld) file '%s' rc=%d\n",
+            (long)size, FnameNVL(fname), rc);
+        return rc==0;
+    }
+
+    virtual int close() {
         if (fstate==FiSt_PreOpened) {
             fprintf(debugfile, "Stream.close *** don't close file '%s', it is preopened\n",
                     FnameNVL(fname));
@@ -124,7 +151,7 @@ public:
         return 0;
     }
 
-    bool isOpen() {
+    virtual bool isOpen() {
         return fstate==FiSt_Opened;
     }
 
@@ -179,6 +206,35 @@ public:
         return File(f, name, FiSt_Opened);
     }
 
+    bool remove(const char *name) {
+        int rc= ::remove(name);
+        fprintf(debugfile, "remove '%s' rc=%d\n", name, rc);
+        return rc==0;
+    }
+
+    int chmod(const char *pathname, int mode) {
+        int rc= ::chmod(pathname, (mode_t)mode);
+        if (rc) {
+            int ern= errno;
+            fprintf(debugfile, "*** Error in chmod '%s' mode 0%o errno=%d: %s\n",
+                pathname, mode, ern, strerror(ern));
+        }
+        return rc;
+    }
+
+    int utime(const char *pathname, uint32_t mtime) {
+        struct utimbuf times;
+        times.actime= (time_t)mtime;
+        times.modtime= (time_t)mtime;
+        int rc= ::utime(pathname, &times);
+        if (rc) {
+            int ern= errno;
+            fprintf(debugfile, "*** Error in utime '%s' errno=%d: %s\n",
+                pathname, ern, strerror(ern));
+        }
+        return rc;
+    }
+
 /* Regarding 'already existing directory' */
 /* we decide to handle it as non-error */
     int mkdir(const char *pathname, mode_t mode) {
@@ -213,6 +269,12 @@ FS SPIFFS;
 #define D4   4
 #define OUTPUT 1
 
+unsigned long millis() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
 int  digitalRead(int)       { return 0; }
 void digitalWrite(int, int) { return; }
 void pinMode(int, int)      { return; }
@@ -0,0 +1,124 @@
+/* tarfs1.cc */
+
+/* Indexes the archive with TarFS and compares every member, read */
+/* in place in odd-sized pieces and after seeks, with the extracted file. */
+/* Then indexes a copy turned into old GNU format: the access times it */
+/* keeps where ustar has the name prefix must not end up in the names */
+
+#include <stdio.h>
+
+#include "stdmapper.h"
+#include "untar.h"
+#include "TarFS.h"
+
+#define PREFIX "tarfs1_ref/"
+#define OLDGNU "tarfs1_oldgnu.tar"
+
+static bool Compare(TarFSFile<File> &tf, FILE *ref, size_t from);
+static int OldGnu(const char *fname, TarFS<File> &ref);
+
+int main(int argc, char **argv) {
+    if (argc!=2) {
+        fprintf(stderr, "usage: %s <filename>\n", argv[0]);
+        return 1;
+    }
+
+    Tar<FS> tar(&SPIFFS, 1);
+    File f= SPIFFS.open(argv[1], "r");
+    if (!f) return 1;
+    tar.open(&f);
+    tar.dest(PREFIX);
+    tar.extract();
+
+    f= SPIFFS.open(argv[1], "r");
+    if (!f) return 1;
+    TarFS<File> tarfs;
+    if (!tarfs.begin(&f)) {
+        fprintf(stderr, "tarfs1: cannot index '%s'\n", argv[1]);
+        return 1;
+    }
+
+    int errors= 0;
+    for (size_t i= 0; i<tarfs.count(); ++i) {
+        char path[256];
+        const char *name= tarfs.name(i);
+
+        snprintf(path, sizeof(path), "/%s", name);     /* as a web server would ask */
+        TarFSFile<File> tf= tarfs.open(path);
+        snprintf(path, sizeof(path), "%s%s", PREFIX, name);
+        FILE *ref= fopen(path, "rb");
+
+        bool ok= ref && tf && Compare(tf, ref, 0) && Compare(tf, ref, tf.size()/2);
+        fprintf(stderr, "tarfs1: %-60s %6ld bytes %s\n",
+            name, (long)tf.size(), ok? "OK": "*** DIFFERS");
+        if (!ok) ++errors;
+        if (ref) fclose(ref);
+        tf.close();
+    }
+    if (tarfs.exists("no/such/file")) ++errors;
+    errors += OldGnu(argv[1], tarfs);
+    f.close();
+    return errors? 1: 0;
+}
+
+/* Copies the archive with each header marked old GNU ("ustar  ") and */
+/* an access time in the prefix field, then expects the same names */
+static int OldGnu(const char *fname, TarFS<File> &ref) {
+    FILE *in= fopen(fname, "rb");
+    FILE *out= fopen(OLDGNU, "wb");
+    char hdr[512];
+    size_t skip= 0;
+    int errors= 0;
+
+    if (!in || !out) return 1;
+    while (fread(hdr, 1, 512, in)==512) {
+        if (skip>0) {
+            skip -= 512;
+        } else if (!TarHeader::is_end_of_archive(hdr)) {
+            if (hdr[156]<'1' || hdr[156]>'6')
+                skip= (TarHeader::parseoct(hdr + 124, 12) + 511) & ~(size_t)511;
+            memcpy(hdr + 257, "ustar  ", 8);
+            snprintf(hdr + 345, 12, "%011o", 014567342341u);   /* atime */
+            memset(hdr + 148, ' ', 8);
+            unsigned sum= 0;
+            for (int n= 0; n<512; ++n) sum += (unsigned char)hdr[n];
+            snprintf(hdr + 148, 8, "%06o", sum);
+        }
+        fwrite(hdr, 1, 512, out);
+    }
+    fclose(in);
+    fclose(out);
+
+    File f= SPIFFS.open(OLDGNU, "r");
+    if (!f) return 1;
+    TarFS<File> tarfs;
+    if (!tarfs.begin(&f) || tarfs.count()!=ref.count()) {
+        fprintf(stderr, "tarfs1: cannot index '%s' as '%s'\n", fname, OLDGNU);
+        return 1;
+    }
+    for (size_t i= 0; i<tarfs.count(); ++i) {
+        if (strcmp(tarfs.name(i), ref.name(i))!=0) {
+            fprintf(stderr, "tarfs1: old GNU member '%s' indexed as '%s'\n",
+                ref.name(i), tarfs.name(i));
+            ++errors;
+        }
+    }
+    if (errors==0)
+        fprintf(stderr, "tarfs1: %ld old GNU members indexed by name\n", (long)tarfs.count());
+    f.close();
+    return errors;
+}
+
+static bool Compare(TarFSFile<File> &tf, FILE *ref, size_t from) {
+    char a[340], b[340];
+    size_t len= 1;
+
+    if (!tf.seek(from) || fseek(ref, (long)from, SEEK_SET)!=0) return false;
+    for (;;) {
+        size_t na= tf.readBytes(a, len);
+        size_t nb= fread(b, 1, len, ref);
+        if (na!=nb || memcmp(a, b, na)!=0) return false;
+        if (na==0) return tf.available()==0;
+        len= len%297 + 37;      /* odd sizes, crossing block boundaries */
+    }
+}
@@ -10,14 +10,34 @@ static struct {
     const char *prefix;
     const char *logfile;
     int msglevel;
+    size_t chunk;
+    long progress;
+    long reports;
 } var= {
     NULL,
     "./",
     NULL,
-    1
+    1,
+    0,
+    -1,
+    -1
 };
 
+/* Progress reports of the current archive, checked if -reports is given */
+static struct {
+    long count;
+    size_t last_done;
+    unsigned last_percent;
+    long short_gaps;        /* reports less than the interval after the previous one */
+    bool last_short;
+    int errors;
+} prog;
+
+static int errors= 0;
+
 static void Test1(const char *fname);
+static void CheckProgress(const char *fname);
+static void Progress(void *ctx, const tar_progress *p);
 static void ParseArgs(int *pargc, char ***pargv);
 
 int main(int argc, char **argv) {
@@ -37,7 +57,7 @@ int main(int argc, char **argv) {
     } else {
         fprintf(stderr, "usage: %s <filename> ...\n", var.progname);
     }
-    return 0;
+    return errors? 1: 0;
 }
 
 static void Test1(const char *fname) {
@@ -51,8 +71,52 @@ static void Test1(const char *fname) {
     }
     tar.open(&f);
     tar.dest(var.prefix);
+    if (var.chunk) tar.chunk(var.chunk);
+    memset(&prog, 0, sizeof(prog));
+    if (var.progress>=0) {
+        struct stat st;
+        if (stat(fname, &st)==0) tar.length(st.st_size);
+        tar.onProgress(Progress, (void *)fname, 0, var.progress);
+    }
     tar.extract();
     if (f) f.close();
+    if (var.reports>=0) CheckProgress(fname);
+}
+
+static void Progress(void *ctx, const tar_progress *p) {
+    fprintf(stderr, "Progress '%s': %s %ld/%ld, archive %ld/%ld %u%% %lu B/s ETA %lu ms\n",
+        (const char *)ctx, p->name, (long)p->member_done, (long)p->member_size,
+        (long)p->archive_done, (long)p->archive_size, p->percent,
+        p->bytes_per_sec, p->eta_ms);
+    if (p->archive_done<prog.last_done || p->percent<prog.last_percent) {
+        fprintf(stderr, "Progress went back from %ld %u%%\n",
+            (long)prog.last_done, prog.last_percent);
+        ++prog.errors;
+    }
+    prog.last_short= p->archive_done - prog.last_done < (size_t)var.progress;
+    if (prog.last_short) ++prog.short_gaps;
+    prog.last_done= p->archive_done;
+    prog.last_percent= p->percent;
+    ++prog.count;
+}
+
+/* Expected: -reports calls, each at least the interval after the previous */
+/* one except the final report, which is at 100% */
+static void CheckProgress(const char *fname) {
+    if (prog.count!=var.reports) {
+        fprintf(stderr, "Test1: '%s' got %ld progress reports, expected %ld\n",
+            fname, prog.count, var.reports);
+        ++prog.errors;
+    }
+    if (prog.short_gaps>(prog.last_short? 1: 0)) {
+        fprintf(stderr, "Test1: '%s' got progress reports within the interval\n", fname);
+        ++prog.errors;
+    }
+    if (prog.count>0 && prog.last_percent!=100) {
+        fprintf(stderr, "Test1: '%s' last progress report at %u%%\n", fname, prog.last_percent);
+        ++prog.errors;
+    }
+    errors += prog.errors;
 }
 
 static void ParseArgs (int *pargc, char ***pargv)
@@ -73,6 +137,16 @@ static void ParseArgs (int *pargc, char ***pargv)
             --argc, ++argv;
             goto NO_MORE_OPT;
 
+        case 'c': case 'C':
+            if (strcasecmp (argv[0], "-chunk")==0) {
+                if (argc<2) goto OPTNVAL;
+                --argc;
+                ++argv;
+                var.chunk= (size_t)atol(argv[0]);
+                break;
+
+            } else goto UNKOPT;
+
         case 'l': case 'L':
             if (strcasecmp (argv[0], "-logfile")==0) {
                 if (argc<2) goto OPTNVAL;
@@ -101,6 +175,23 @@ static void ParseArgs (int *pargc, char ***pargv)
                 var.prefix= argv[0][0] ? argv[0]: NULL;
                 break;
 
+            } else if (strcasecmp (argv[0], "-progress")==0) {  /* report every N bytes */
+                if (argc<2) goto OPTNVAL;
+                --argc;
+                ++argv;
+                var.progress= atol(argv[0]);
+                break;
+
+            } else goto UNKOPT;
+
+        case 'r': case 'R':
+            if (strcasecmp (argv[0], "-reports")==0) {  /* expected number of progress reports */
+                if (argc<2) goto OPTNVAL;
+                --argc;
+                ++argv;
+                var.reports= atol(argv[0]);
+                break;
+
             } else goto UNKOPT;
 
         default: